@@ -2,18 +2,54 @@
 #define ATE_ASSEMBLY_HPP
 
 namespace ate {
+    /// pointer with a tag for double width compare and swap. The tag is 
+    /// changed on every update so that a recycled pointer is detected (ABA).
+    struct TaggedPtr {
+        void* ptr;
+        size_t tag;
+    } __attribute__((aligned(2 * sizeof(void*))));
+
     // swap *mem with val and return old value of *mem
     inline int testAndSet(volatile int* mem);
     inline int cmpAndSwap(volatile int* mem, int cmpVal, int newVal);
+    // pointer sized versions of cmpAndSwap() and swap
+    inline void* cmpAndSwapPtr(void* volatile* mem, void* cmpVal, void* newVal);
+    inline void* fetchAndStorePtr(void* volatile* mem, void* val);
+    // double width: store newVal if *mem equals cmpVal and return true, 
+    // otherwise load *mem into cmpVal and return false
+    inline bool cmpAndSwap2(volatile TaggedPtr* mem, TaggedPtr& cmpVal,
+                            const TaggedPtr& newVal);
+    // add or subtract val from *mem and return old value of *mem
+    inline int fetchAndAdd(volatile int* mem, int val);
+    inline long fetchAndAdd(volatile long* mem, long val);
+    inline int fetchAndSub(volatile int* mem, int val);
+    inline long fetchAndSub(volatile long* mem, long val);
+    // store val into *mem and return old value of *mem
+    inline int exchange(volatile int* mem, int val);
+    inline long exchange(volatile long* mem, long val);
+    // 64-bit cmpAndSwap(), also on 32-bit platforms
+    inline uint64_t cmpAndSwap64(volatile uint64_t* mem, uint64_t cmpVal,
+                                 uint64_t newVal);
     inline void cpuPause();    
     inline void cpuPause(int delay); 
+    // compiler only barrier
     inline void barrier();
+    // ordering of plain memory: no load moves above acquireFence(), no 
+    // store moves below releaseFence() and nothing crosses seqFence()
+    inline void acquireFence();
+    inline void releaseFence();
+    inline void seqFence();
+    // read, write and full barriers that also order non-temporal stores
+    // and write-combining memory
     inline void rmembar();
     inline void wmembar();
     inline void membar();
     inline uint64_t getClockTicks();
 } // namespace ate
 
+// __atomic builtins in namespace ate::builtin, always available
+#include <ate/arch/Assembly_builtin.hpp>
+
 // include internal header file for platform specific implementaion
 #ifdef __i686__
 #include <ate/arch/Assembly_i686.hpp>
@@ -24,11 +60,8 @@ namespace ate {
 #elif defined(__x86_64__)
 #include <ate/arch/Assembly_x86_64.hpp>
 
-#elif defined(__ia_64__)
-#error "ate Atomic operations for IA64 have not been implemented"
-
 #else
-#error "this platform is not supported"
+#include <ate/arch/Assembly_generic.hpp>
 #endif    
 
 #endif // ATE_ASSEMBLY_HPP
@@ -0,0 +1,148 @@
+#ifndef ATE_ASSEMBLY_HPP
+#error "Do not include this file directly; include ate/Assembly.hpp instead"
+#else 
+
+#include <time.h>
+
+namespace ate {
+    /// the operations of Assembly.hpp on top of the gcc __atomic builtins.
+    /// Used where no hand written assembly exists and for comparison.
+    namespace builtin {
+        inline int testAndSet(volatile int* mem)
+        {
+            return __atomic_exchange_n(mem, 1, __ATOMIC_ACQUIRE);
+        }
+
+        inline int cmpAndSwap(volatile int* mem, int cmpVal, int newVal)
+        {
+            __atomic_compare_exchange_n(mem, &cmpVal, newVal, false,
+                                        __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST);
+            return cmpVal;
+        }
+
+        inline void* cmpAndSwapPtr(void* volatile* mem, void* cmpVal, 
+                                   void* newVal)
+        {
+            __atomic_compare_exchange_n(mem, &cmpVal, newVal, false,
+                                        __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST);
+            return cmpVal;
+        }
+
+        inline void* fetchAndStorePtr(void* volatile* mem, void* val)
+        {
+            return __atomic_exchange_n(mem, val, __ATOMIC_SEQ_CST);
+        }
+
+        inline bool cmpAndSwap2(volatile TaggedPtr* mem, TaggedPtr& cmpVal,
+                                const TaggedPtr& newVal)
+        {
+            // may need libatomic (-latomic) without -mcx16
+            return __atomic_compare_exchange(
+                const_cast<TaggedPtr*>(mem), &cmpVal, 
+                const_cast<TaggedPtr*>(&newVal), false,
+                __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST);
+        }
+
+        inline int fetchAndAdd(volatile int* mem, int val)
+        {
+            return __atomic_fetch_add(mem, val, __ATOMIC_SEQ_CST);
+        }
+
+        inline long fetchAndAdd(volatile long* mem, long val)
+        {
+            return __atomic_fetch_add(mem, val, __ATOMIC_SEQ_CST);
+        }
+
+        inline int fetchAndSub(volatile int* mem, int val)
+        {
+            return __atomic_fetch_sub(mem, val, __ATOMIC_SEQ_CST);
+        }
+
+        inline long fetchAndSub(volatile long* mem, long val)
+        {
+            return __atomic_fetch_sub(mem, val, __ATOMIC_SEQ_CST);
+        }
+
+        inline int exchange(volatile int* mem, int val)
+        {
+            return __atomic_exchange_n(mem, val, __ATOMIC_SEQ_CST);
+        }
+
+        inline long exchange(volatile long* mem, long val)
+        {
+            return __atomic_exchange_n(mem, val, __ATOMIC_SEQ_CST);
+        }
+
+        inline uint64_t cmpAndSwap64(volatile uint64_t* mem, uint64_t cmpVal,
+                                     uint64_t newVal)
+        {
+            __atomic_compare_exchange_n(mem, &cmpVal, newVal, false,
+                                        __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST);
+            return cmpVal;
+        }
+
+        inline void barrier()
+        {
+            __atomic_signal_fence(__ATOMIC_SEQ_CST);
+        }
+
+        inline void cpuPause()
+        {
+#if defined(__i386__) || defined(__x86_64__)
+            __builtin_ia32_pause();
+#else
+            barrier();
+#endif
+        }
+
+        inline void cpuPause(int delay) 
+        {
+            for (int i = 0; i < delay; ++i)
+                cpuPause();
+        }
+
+        inline void acquireFence()
+        {
+            __atomic_thread_fence(__ATOMIC_ACQUIRE);
+        }
+
+        inline void releaseFence()
+        {
+            __atomic_thread_fence(__ATOMIC_RELEASE);
+        }
+
+        inline void seqFence()
+        {
+            __atomic_thread_fence(__ATOMIC_SEQ_CST);
+        }
+
+        inline void rmembar()
+        {
+            __atomic_thread_fence(__ATOMIC_SEQ_CST);
+        }
+
+        inline void wmembar()
+        {
+            __atomic_thread_fence(__ATOMIC_SEQ_CST);
+        }
+
+        inline void membar()
+        {
+            __atomic_thread_fence(__ATOMIC_SEQ_CST);
+        }
+
+        /// cpu ticks where available, nanoseconds otherwise
+        inline uint64_t getClockTicks()
+        {
+#if defined(__i386__) || defined(__x86_64__)
+            return __builtin_ia32_rdtsc();
+#else
+            timespec ts;
+            clock_gettime(CLOCK_MONOTONIC, &ts);
+            return ts.tv_sec * (uint64_t)1000000000 + ts.tv_nsec;
+#endif
+        }
+    } // namespace builtin
+} // namespace ate 
+
+#endif
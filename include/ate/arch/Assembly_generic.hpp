@@ -0,0 +1,120 @@
+#ifndef ATE_ASSEMBLY_HPP
+#error "Do not include this file directly; include ate/Assembly.hpp instead"
+#else 
+
+// platforms without hand written assembly use the builtin versions
+namespace ate {
+    inline int testAndSet(volatile int* mem)
+    {
+        return builtin::testAndSet(mem);
+    }
+
+    inline int cmpAndSwap(volatile int* mem, int cmpVal, int newVal)
+    {
+        return builtin::cmpAndSwap(mem, cmpVal, newVal);
+    }
+
+    inline void* cmpAndSwapPtr(void* volatile* mem, void* cmpVal, void* newVal)
+    {
+        return builtin::cmpAndSwapPtr(mem, cmpVal, newVal);
+    }
+
+    inline void* fetchAndStorePtr(void* volatile* mem, void* val)
+    {
+        return builtin::fetchAndStorePtr(mem, val);
+    }
+
+    inline bool cmpAndSwap2(volatile TaggedPtr* mem, TaggedPtr& cmpVal,
+                            const TaggedPtr& newVal)
+    {
+        return builtin::cmpAndSwap2(mem, cmpVal, newVal);
+    }
+
+    inline int fetchAndAdd(volatile int* mem, int val)
+    {
+        return builtin::fetchAndAdd(mem, val);
+    }
+
+    inline long fetchAndAdd(volatile long* mem, long val)
+    {
+        return builtin::fetchAndAdd(mem, val);
+    }
+
+    inline int fetchAndSub(volatile int* mem, int val)
+    {
+        return builtin::fetchAndSub(mem, val);
+    }
+
+    inline long fetchAndSub(volatile long* mem, long val)
+    {
+        return builtin::fetchAndSub(mem, val);
+    }
+
+    inline int exchange(volatile int* mem, int val)
+    {
+        return builtin::exchange(mem, val);
+    }
+
+    inline long exchange(volatile long* mem, long val)
+    {
+        return builtin::exchange(mem, val);
+    }
+
+    inline uint64_t cmpAndSwap64(volatile uint64_t* mem, uint64_t cmpVal,
+                                 uint64_t newVal)
+    {
+        return builtin::cmpAndSwap64(mem, cmpVal, newVal);
+    }
+
+    inline void cpuPause()
+    {
+        builtin::cpuPause();
+    }
+
+    inline void cpuPause(int delay)
+    {
+        builtin::cpuPause(delay);
+    }
+
+    inline void barrier()
+    {
+        builtin::barrier();
+    }
+
+    inline void acquireFence()
+    {
+        builtin::acquireFence();
+    }
+
+    inline void releaseFence()
+    {
+        builtin::releaseFence();
+    }
+
+    inline void seqFence()
+    {
+        builtin::seqFence();
+    }
+
+    inline void rmembar()
+    {
+        builtin::rmembar();
+    }
+
+    inline void wmembar()
+    {
+        builtin::wmembar();
+    }
+
+    inline void membar()
+    {
+        builtin::membar();
+    }
+
+    inline uint64_t getClockTicks()
+    {
+        return builtin::getClockTicks();
+    }
+} // namespace ate 
+
+#endif
@@ -28,6 +28,102 @@ namespace ate {
         
     }
 
+    inline void* cmpAndSwapPtr(void* volatile* mem, void* cmpVal, void* newVal)
+    {
+        void* prev;
+        __asm__ volatile ("lock cmpxchgl %1, %2"
+                          : "=a" (prev)
+                          : "r" (newVal), "m" (*mem), "0" (cmpVal)
+                          : "memory" );
+        return prev;
+    }
+
+    inline void* fetchAndStorePtr(void* volatile* mem, void* val)
+    {
+        // xchg with a memory operand is always locked
+        __asm__ volatile ("xchgl %0, %1"
+                          : "=r" (val), "+m" (*mem)
+                          : "0" (val)
+                          : "memory" );
+        return val;
+    }
+
+    inline bool cmpAndSwap2(volatile TaggedPtr* mem, TaggedPtr& cmpVal,
+                            const TaggedPtr& newVal)
+    {
+        bool ok;
+        // ebx may hold the GOT pointer in PIC code, pass the value in esi
+        __asm__ volatile ("xchgl %%ebx, %%esi\n\t"
+                          "lock cmpxchg8b %1\n\t"
+                          "xchgl %%ebx, %%esi\n\t"
+                          "setz %0"
+                          : "=q" (ok), "+m" (*mem), 
+                            "+a" (cmpVal.ptr), "+d" (cmpVal.tag)
+                          : "S" (newVal.ptr), "c" (newVal.tag)
+                          : "memory" );
+        return ok;
+    }
+
+    inline int fetchAndAdd(volatile int* mem, int val)
+    {
+        __asm__ volatile ("lock xaddl %0, %1"
+                          : "+r" (val), "+m" (*mem)
+                          :
+                          : "memory" );
+        return val;
+    }
+
+    inline long fetchAndAdd(volatile long* mem, long val)
+    {
+        __asm__ volatile ("lock xaddl %0, %1"
+                          : "+r" (val), "+m" (*mem)
+                          :
+                          : "memory" );
+        return val;
+    }
+
+    inline int fetchAndSub(volatile int* mem, int val)
+    {
+        return fetchAndAdd(mem, -val);
+    }
+
+    inline long fetchAndSub(volatile long* mem, long val)
+    {
+        return fetchAndAdd(mem, -val);
+    }
+
+    inline int exchange(volatile int* mem, int val)
+    {
+        __asm__ volatile ("xchgl %0, %1"
+                          : "+r" (val), "+m" (*mem)
+                          :
+                          : "memory" );
+        return val;
+    }
+
+    inline long exchange(volatile long* mem, long val)
+    {
+        __asm__ volatile ("xchgl %0, %1"
+                          : "+r" (val), "+m" (*mem)
+                          :
+                          : "memory" );
+        return val;
+    }
+
+    inline uint64_t cmpAndSwap64(volatile uint64_t* mem, uint64_t cmpVal,
+                                 uint64_t newVal)
+    {
+        // ebx may hold the GOT pointer in PIC code, pass the value in esi
+        __asm__ volatile ("xchgl %%ebx, %%esi\n\t"
+                          "lock cmpxchg8b %0\n\t"
+                          "xchgl %%ebx, %%esi"
+                          : "+m" (*mem), "+A" (cmpVal)
+                          : "S" ((uint32_t)newVal), 
+                            "c" ((uint32_t)(newVal >> 32))
+                          : "memory" );
+        return cmpVal;
+    }
+
     inline void cpuPause()
     {
         __asm__ volatile ("pause;");
@@ -45,20 +141,58 @@ namespace ate {
         __asm__ volatile ("" : : : "memory" );
     }
     
-    inline void rmembar()
+    // loads are not reordered with older loads and stores are not reordered
+    // with older stores on x86, only store-load needs a real fence
+    inline void acquireFence()
     {
         __asm__ volatile ("" : : : "memory" );
     }
     
-    inline void wmembar()
+    inline void releaseFence()
     {
         __asm__ volatile ("" : : : "memory" );
     }
     
+    // a locked instruction on the stack is cheaper than mfence and orders
+    // all ordinary memory accesses the same way
+    inline void seqFence()
+    {
+        __asm__ volatile ("lock; addl $0, (%%esp)" : : : "memory" );
+    }
+    
+    // without SSE2 there are no fence instructions (and no non-temporal
+    // stores), the locked instruction is used instead
+#ifdef __SSE2__
+    inline void rmembar()
+    {
+        __asm__ volatile ("lfence" : : : "memory" );
+    }
+    
+    inline void wmembar()
+    {
+        __asm__ volatile ("sfence" : : : "memory" );
+    }
+    
     inline void membar()
     {
-        __asm__ volatile ("" : : : "memory" );
+        __asm__ volatile ("mfence" : : : "memory" );
     }
+#else
+    inline void rmembar()
+    {
+        seqFence();
+    }
+    
+    inline void wmembar()
+    {
+        seqFence();
+    }
+    
+    inline void membar()
+    {
+        seqFence();
+    }
+#endif
     
     inline uint64_t getClockTicks()
     {        
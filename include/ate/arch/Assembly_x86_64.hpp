@@ -29,6 +29,96 @@ namespace ate {
         
     }
 
+    inline void* cmpAndSwapPtr(void* volatile* mem, void* cmpVal, void* newVal)
+    {
+        void* prev;
+        __asm__ volatile ("lock cmpxchgq %1, %2"
+                          : "=a" (prev)
+                          : "r" (newVal), "m" (*mem), "0" (cmpVal)
+                          : "memory" );
+        return prev;
+    }
+
+    inline void* fetchAndStorePtr(void* volatile* mem, void* val)
+    {
+        // xchg with a memory operand is always locked
+        __asm__ volatile ("xchgq %0, %1"
+                          : "=r" (val), "+m" (*mem)
+                          : "0" (val)
+                          : "memory" );
+        return val;
+    }
+
+    inline bool cmpAndSwap2(volatile TaggedPtr* mem, TaggedPtr& cmpVal,
+                            const TaggedPtr& newVal)
+    {
+        bool ok;
+        __asm__ volatile ("lock cmpxchg16b %1\n\t"
+                          "setz %0"
+                          : "=q" (ok), "+m" (*mem), 
+                            "+a" (cmpVal.ptr), "+d" (cmpVal.tag)
+                          : "b" (newVal.ptr), "c" (newVal.tag)
+                          : "memory" );
+        return ok;
+    }
+
+    inline int fetchAndAdd(volatile int* mem, int val)
+    {
+        __asm__ volatile ("lock xaddl %0, %1"
+                          : "+r" (val), "+m" (*mem)
+                          :
+                          : "memory" );
+        return val;
+    }
+
+    inline long fetchAndAdd(volatile long* mem, long val)
+    {
+        __asm__ volatile ("lock xaddq %0, %1"
+                          : "+r" (val), "+m" (*mem)
+                          :
+                          : "memory" );
+        return val;
+    }
+
+    inline int fetchAndSub(volatile int* mem, int val)
+    {
+        return fetchAndAdd(mem, -val);
+    }
+
+    inline long fetchAndSub(volatile long* mem, long val)
+    {
+        return fetchAndAdd(mem, -val);
+    }
+
+    inline int exchange(volatile int* mem, int val)
+    {
+        __asm__ volatile ("xchgl %0, %1"
+                          : "+r" (val), "+m" (*mem)
+                          :
+                          : "memory" );
+        return val;
+    }
+
+    inline long exchange(volatile long* mem, long val)
+    {
+        __asm__ volatile ("xchgq %0, %1"
+                          : "+r" (val), "+m" (*mem)
+                          :
+                          : "memory" );
+        return val;
+    }
+
+    inline uint64_t cmpAndSwap64(volatile uint64_t* mem, uint64_t cmpVal,
+                                 uint64_t newVal)
+    {
+        uint64_t prev;
+        __asm__ volatile ("lock cmpxchgq %1, %2"
+                          : "=a" (prev)
+                          : "r" (newVal), "m" (*mem), "0" (cmpVal)
+                          : "memory" );
+        return prev;
+    }
+
     inline void cpuPause()
     {
         __asm__ volatile ("pause;");
@@ -46,19 +136,38 @@ namespace ate {
         __asm__ volatile ("" : : : "memory" );
     }
     
-    inline void rmembar()
+    // loads are not reordered with older loads and stores are not reordered
+    // with older stores on x86, only store-load needs a real fence
+    inline void acquireFence()
     {
         __asm__ volatile ("" : : : "memory" );
     }
     
-    inline void wmembar()
+    inline void releaseFence()
     {
         __asm__ volatile ("" : : : "memory" );
     }
     
+    // a locked instruction on the stack is cheaper than mfence and orders
+    // all ordinary memory accesses the same way
+    inline void seqFence()
+    {
+        __asm__ volatile ("lock; orl $0, (%%rsp)" : : : "memory" );
+    }
+    
+    inline void rmembar()
+    {
+        __asm__ volatile ("lfence" : : : "memory" );
+    }
+    
+    inline void wmembar()
+    {
+        __asm__ volatile ("sfence" : : : "memory" );
+    }
+    
     inline void membar()
     {
-        __asm__ volatile ("" : : : "memory" );
+        __asm__ volatile ("mfence" : : : "memory" );
     }
     
     inline uint64_t getClockTicks()
@@ -17,6 +17,7 @@
 #include <iostream>
 #include <sstream>
 #include <vector>
+#include <algorithm>
 
 #define ATE_ABORT(msg) {                                                \
         int errnum = errno;                                             \
@@ -36,12 +37,18 @@
             ATE_ABORT(#expr " assert failed");  \
         }                                       \
     }
+
+#include <ate/arch/Assembly.hpp>
+
 namespace ate {  
     union Alignment {
         double d;
         void* v;
     };
 
+    /// assumed size of a cache line, used to keep hot shared words apart
+    const size_t CACHE_LINE_SIZE = 64;
+
     /**
      * align() works only with power of 2 blocks and 
      * assumes 2's complement arithmetic.
@@ -52,38 +59,186 @@ namespace ate {
             ~(sizeof(union Alignment) - 1);
     }
     
+    /**
+     * AllocStats are the counters of an allocator. Only the thread that 
+     * allocates writes them, other threads may read them without locking:
+     * each counter is an aligned word, so a read never tears, but the 
+     * counters in one snapshot may be from slightly different moments.
+     */
+    struct AllocStats {
+        const char* name;
+        volatile size_t inUse;    // blocks handed out (bytes for Bin)
+        volatile size_t peak;     // high water mark of inUse
+        volatile size_t capacity; // blocks carved (chunks for Bin)
+        volatile size_t grows;    // grow events
+        volatile size_t reserved; // bytes taken from the system
+        volatile size_t wasted;   // bytes left unused at the end of chunks
+    };
+
+    /// called after an allocator grows, it must not use that allocator
+    typedef void (*GrowHook)(const AllocStats& stats);
+
+    /**
+     * AllocCounters are AllocStats that are listed by AllocRegistry while
+     * they live. 
+     */
+    class AllocCounters : public AllocStats {
+    public:
+        AllocCounters(const char* name);
+        ~AllocCounters();
+        void use(size_t n) {
+            inUse += n;
+            if (inUse > peak)
+                peak = inUse;
+        }
+        void unuse(size_t n) { inUse -= n; }
+        /// count a grow event and call the grow hook
+        void grown(size_t blocks, size_t bytes);
+        void shrunk(size_t blocks, size_t bytes) {
+            capacity -= blocks;
+            reserved -= bytes;
+        }
+    private:
+        friend class AllocRegistry;
+        AllocCounters(const AllocCounters&);
+        AllocCounters& operator=(const AllocCounters&);
+        AllocCounters* m_prev;
+        AllocCounters* m_next;
+    };
+
+    /**
+     * AllocRegistry knows the counters of every live Pool, Bin, FastQueue 
+     * and the other allocators by name.
+     */
+    class AllocRegistry {
+    public:
+        /// copy the stats of all allocators
+        static void snapshot(std::vector<AllocStats>& stats);
+        /// the hook is NULL by default, growing is silent then.
+        /// returns the previous hook
+        static GrowHook setGrowHook(GrowHook hook);
+    private:
+        friend class AllocCounters;
+        static void add(AllocCounters* counters);
+        static void remove(AllocCounters* counters);
+        static void grown(const AllocStats& stats);
+    };
+
+    /**
+     * RegionPolicy tells Region where its chunks come from. The mmap() 
+     * backings round every chunk up to the page size (2 MB for huge pages)
+     * and can be bound to a NUMA node.
+     */
+    struct RegionPolicy {
+        enum Backing {
+            HEAP,      // ::malloc()
+            MMAP,      // anonymous mmap() 
+            HUGE_PAGE, // anonymous mmap() + madvise(MADV_HUGEPAGE)
+            HUGETLB    // mmap(MAP_HUGETLB), falls back to HUGE_PAGE
+        };
+        Backing backing;
+        int numaNode; // mbind() mmap chunks to this node, -1 for no binding
+        RegionPolicy(Backing b = HEAP, int node = -1) 
+            : backing(b), numaNode(node) {}
+    };
+
     class Region {
     public:
         union Link {
-            Link* next;
-            Alignment a;
+            struct {
+                Link* next;
+                Link* prev;
+                size_t size; // bytes of the chunk including this header
+            } info;
+            Alignment a[2]; // a multiple of Alignment on 32 and 64 bits
         };
-        Region();
+        Region(const RegionPolicy& policy = RegionPolicy());
         ~Region();
         /// returns a pointer to memory of size n bytes
         void* malloc(size_t n);
+        /// returns memory from malloc() to the system before ~Region()
+        void free(void* ptr);
+        /// bytes available when malloc(n) is called, always >= n
+        size_t usable(size_t n) const;
+        const RegionPolicy& policy() const { return m_policy; }
+        /// bytes taken from the system, readable from any thread
+        size_t bytes() const { return m_bytes; }
+        /// number of chunks, readable from any thread
+        size_t chunks() const { return m_chunks; }
     private:
+        Region(const Region&);
+        Region& operator=(const Region&);
+        void* map(size_t len);
         Link* m_head;
+        RegionPolicy m_policy;
+        volatile size_t m_bytes;
+        volatile size_t m_chunks;
     };
         
     /**
      * Bin can be used for memory that is released when the program exits.
+     * It can also be a per request arena: take a mark() before the request
+     * and rewind() to it afterwards, or use BinScope. Chunks filled after 
+     * the mark are kept for reuse, big blocks are returned to the system.
      */
     class Bin {
     public:
-        Bin();
+        /// position of the bin, valid until the bin rewinds beyond it
+        struct Mark {
+            void* chunk;
+            char* cur;
+            void* big;
+            size_t used;
+            size_t wasted;
+        };
+        /// zero: whether alloc(n) fills memory with 0
+        Bin(const RegionPolicy& policy = RegionPolicy(), bool zero = true,
+            const char* name = "Bin");
         ~Bin();
-        void* alloc(size_t n, bool zero = true);
+        void* alloc(size_t n) { return alloc(n, m_zero); }
+        void* alloc(size_t n, bool zero);
         char* strdup(const char* str);
         template<typename T> inline
         T* create() { return new(alloc(sizeof(T))) T; }
+        Mark mark() const;
+        /// release everything allocated after mark m
+        void rewind(const Mark& m);
+        /// release everything, the first chunk is kept
+        void reset();
+        const AllocStats& stats() const { return m_stats; }
     private:
+        union Chunk {
+            Chunk* prev;
+            Alignment a;
+        };
+        Bin(const Bin&);
+        Bin& operator=(const Bin&);
+        void nextChunk();
         Region m_region;
         char* m_cur;
         char* m_end;
+        size_t m_size; // chunk size, s_size rounded up by the region
+        bool m_zero;
+        Chunk* m_first;
+        Chunk* m_chunk; // chunk of m_cur
+        Chunk* m_spare; // chunks released by rewind()
+        Chunk* m_big;   // blocks bigger than a chunk, most recent first
+        AllocCounters m_stats;
         static const size_t s_size;
     };
 
+    /**
+     * BinScope rewinds a Bin to where it was when the scope was entered.
+     */
+    class BinScope {
+    public:
+        BinScope(Bin& bin) : m_bin(bin), m_mark(bin.mark()) {}
+        ~BinScope() { m_bin.rewind(m_mark); }
+    private:
+        Bin& m_bin;
+        Bin::Mark m_mark;
+    };
+
     /**
      * Pool allocates memory for objects of the same type. 
      */
@@ -96,20 +251,294 @@ namespace ate {
         };
         Pool(const char* name = "Pool", 
              size_t initBlocks = 128, 
-             size_t maxIncrement = 1024);
+             size_t maxIncrement = 1024,
+             const RegionPolicy& policy = RegionPolicy());
         /// return a pointer to a T object
         T* alloc();
         /// put memory back to free list. ptr has to be from Pool.alloc() 
         inline void dealloc(T* ptr);
+        /// store n pointers to T objects in out[]
+        void allocBulk(size_t n, T** out);
+        /// put n blocks back to free list in one splice
+        void deallocBulk(size_t n, T* const* ptrs);
+        /**
+         * return chunks whose blocks are all free to the system, keeping 
+         * at least keepBlocks free blocks. It walks the whole free list, 
+         * call it when the pool is idle, e.g. from an EventLoop timer.
+         * returns the number of blocks released.
+         */
+        size_t trim(size_t keepBlocks = 0);
+        /// number of blocks carved from the region
+        size_t capacity() const { return m_size; }
+        const AllocStats& stats() const { return m_stats; }
         /// destructor releases all allocated memory 
         ~Pool() {}
     private:
+        struct Chunk {
+            Block* first;
+            size_t nBlocks;
+            size_t nFree;  // used by trim() only
+            bool released; // used by trim() only
+            bool operator<(const Chunk& c) const { return first < c.first; }
+        };
         void grow(size_t nBlocks);
+        Chunk* findChunk(Block* block);
         const char* m_name;
         Region m_region;
         Block* m_head;
         size_t m_maxIncr;
         size_t m_size;
+        std::vector<Chunk> m_chunks; 
+        AllocCounters m_stats;
+    };
+
+    /**
+     * ObjectPool is a Pool that runs constructors and destructors. 
+     * construct() takes up to 4 constructor arguments.
+     */
+    template <typename T>
+    class ObjectPool {
+    public:
+        ObjectPool(const char* name = "ObjectPool", 
+                   size_t initBlocks = 128, 
+                   size_t maxIncrement = 1024,
+                   const RegionPolicy& policy = RegionPolicy())
+            : m_pool(name, initBlocks, maxIncrement, policy) {}
+        T* construct() { return new(m_pool.alloc()) T(); }
+        template <typename A1> 
+        T* construct(const A1& a1) { return new(m_pool.alloc()) T(a1); }
+        template <typename A1, typename A2> 
+        T* construct(const A1& a1, const A2& a2) {
+            return new(m_pool.alloc()) T(a1, a2);
+        }
+        template <typename A1, typename A2, typename A3> 
+        T* construct(const A1& a1, const A2& a2, const A3& a3) {
+            return new(m_pool.alloc()) T(a1, a2, a3);
+        }
+        template <typename A1, typename A2, typename A3, typename A4> 
+        T* construct(const A1& a1, const A2& a2, const A3& a3, const A4& a4) {
+            return new(m_pool.alloc()) T(a1, a2, a3, a4);
+        }
+        /// ptr has to be from construct()
+        void destroy(T* ptr) {
+            ptr->~T();
+            m_pool.dealloc(ptr);
+        }
+        /// raw memory for n objects, the caller constructs them
+        void allocBulk(size_t n, T** out) { m_pool.allocBulk(n, out); }
+        /// put back raw memory of n objects that are already destroyed
+        void deallocBulk(size_t n, T* const* ptrs) { 
+            m_pool.deallocBulk(n, ptrs); 
+        }
+        /// n default constructed objects
+        void constructBulk(size_t n, T** out) {
+            m_pool.allocBulk(n, out);
+            for (size_t i = 0; i < n; ++i)
+                new(out[i]) T();
+        }
+        /// destroy n objects from construct() and free them in one splice
+        void destroyBulk(size_t n, T* const* ptrs) {
+            for (size_t i = 0; i < n; ++i)
+                ptrs[i]->~T();
+            m_pool.deallocBulk(n, ptrs);
+        }
+        Pool<T>& pool() { return m_pool; }
+    private:
+        Pool<T> m_pool;
+    };
+
+    /// PoolDeleter destroys an object of an ObjectPool, e.g. for unique_ptr
+    template <typename T>
+    struct PoolDeleter {
+        ObjectPool<T>* pool;
+        PoolDeleter(ObjectPool<T>* p = NULL) : pool(p) {}
+        void operator()(T* ptr) const { 
+            if (ptr != NULL) 
+                pool->destroy(ptr); 
+        }
+    };
+
+    /**
+     * PoolPtr owns one object of an ObjectPool and destroys it when it goes
+     * out of scope. It can not be copied, use release() to give it away.
+     */
+    template <typename T>
+    class PoolPtr {
+    public:
+        PoolPtr(ObjectPool<T>& pool, T* ptr = NULL) 
+            : m_deleter(&pool), m_ptr(ptr) {}
+        ~PoolPtr() { m_deleter(m_ptr); }
+        T* get() const { return m_ptr; }
+        T& operator*() const { return *m_ptr; }
+        T* operator->() const { return m_ptr; }
+        /// give up ownership without destroying the object
+        T* release() {
+            T* ptr = m_ptr;
+            m_ptr = NULL;
+            return ptr;
+        }
+        /// destroy the owned object and take ptr
+        void reset(T* ptr = NULL) {
+            if (ptr != m_ptr) {
+                m_deleter(m_ptr);
+                m_ptr = ptr;
+            }
+        }
+    private:
+        PoolPtr(const PoolPtr&);
+        PoolPtr& operator=(const PoolPtr&);
+        PoolDeleter<T> m_deleter;
+        T* m_ptr;
+    };
+
+    /**
+     * SlabAllocator allocates variable size memory from size classes of 
+     * 32, 48, 64, 96, ... 49152, 65536 bytes. Each class keeps a Pool style 
+     * free list carved from its own Region. Bigger requests are mapped 
+     * directly with mmap() and unmapped on free(). It is not thread safe.
+     */
+    class SlabAllocator {
+    public:
+        enum {
+            MIN_SIZE = 32,
+            MAX_SIZE = 64 * 1024,
+            CLASS_COUNT = 23
+        };
+        struct Stats {
+            size_t blockSize; // usable bytes per block
+            size_t inUse;     // blocks handed out
+            size_t peak;      // high water mark of inUse
+            size_t capacity;  // blocks carved from the region
+        };
+        SlabAllocator(const char* name = "SlabAllocator", 
+                      size_t chunkSize = 64 * 1024);
+        ~SlabAllocator();
+        /// returns aligned memory of at least n bytes
+        void* malloc(size_t n);
+        /// ptr has to be from SlabAllocator.malloc() or NULL
+        void free(void* ptr);
+        /// stats of size class i, 0 <= i < CLASS_COUNT
+        const Stats& stats(size_t i) const { return m_classes[i].stats; }
+        /// stats of the mmap() path: inUse and peak count live mappings, 
+        /// blockSize is the number of bytes currently mapped
+        const Stats& largeStats() const { return m_large; }
+        /// size class for a request of n bytes, n <= MAX_SIZE
+        static size_t sizeClass(size_t n);
+        /// totals of all size classes
+        const AllocStats& totals() const { return m_stats; }
+    private:
+        union Header {
+            size_t tag; // size class, or mapped length for large blocks
+            Alignment a;
+        };
+        union Block {
+            Block* next;
+            Header header;
+        };
+        struct SizeClass {
+            Region region;
+            Block* head;
+            Stats stats;
+        };
+        SlabAllocator(const SlabAllocator&);
+        SlabAllocator& operator=(const SlabAllocator&);
+        void grow(SizeClass& sc);
+        void* mallocLarge(size_t n);
+        const char* m_name;
+        size_t m_chunkSize;
+        SizeClass m_classes[CLASS_COUNT];
+        Stats m_large;
+        AllocCounters m_stats;
+    };
+
+    /**
+     * VirtualRange reserves address space without backing memory and 
+     * commits it from the start as needed, so committed memory never moves.
+     */
+    class VirtualRange {
+    public:
+        VirtualRange(size_t maxBytes);
+        ~VirtualRange();
+        char* base() const { return m_base; }
+        size_t committed() const { return m_committed; }
+        size_t reserved() const { return m_reserved; }
+        /// make the first n bytes usable, return false if n > reserved()
+        bool commit(size_t n);
+    private:
+        VirtualRange(const VirtualRange&);
+        VirtualRange& operator=(const VirtualRange&);
+        char* m_base;
+        size_t m_reserved;
+        size_t m_committed;
+    };
+
+    /**
+     * HandlePool keeps objects in one contiguous VirtualRange and hands out
+     * 32-bit handles instead of pointers. A handle holds the slot index in 
+     * the low IndexBits (at most 30) and the slot generation in the rest. 
+     * The generation changes on every alloc and dealloc (odd while the slot
+     * is live), so get() returns NULL for a stale handle. Free slots are 
+     * reused FIFO, so a stale handle can only match again after its slot 
+     * went 2^(31 - IndexBits) times through the whole free list. 0 is 
+     * never a valid handle. maxSlots objects are reserved as address space
+     * up front. Like Pool, it returns raw memory and is not thread safe.
+     */
+    template <typename T, int IndexBits = 24>
+    class HandlePool {
+    public:
+        typedef uint32_t Handle;
+        enum {
+            INDEX_BITS = IndexBits,
+            INDEX_MASK = (1 << INDEX_BITS) - 1,
+            GEN_MASK = 0xffffffffU >> INDEX_BITS,
+            MAX_SLOTS = 1 << INDEX_BITS,
+            DEFAULT_SLOTS = 1 << 16,
+            NULL_HANDLE = 0
+        };
+        HandlePool(const char* name = "HandlePool", 
+                   size_t maxSlots = DEFAULT_SLOTS, 
+                   size_t increment = 1024);
+        /// handle of a free slot, aborts when maxSlots are live
+        Handle alloc();
+        /// h has to be live
+        void dealloc(Handle h);
+        /// the object of h, NULL if h is stale
+        inline T* get(Handle h) const;
+        /// the object of a live handle without checking
+        T* operator[](Handle h) const { return slot(h & INDEX_MASK); }
+        /// handle of a live object from this pool
+        Handle handleOf(const T* ptr) const;
+        /// slots [0, capacity()) can be scanned with live() and slot()
+        size_t capacity() const { return m_capacity; }
+        bool live(size_t index) const { return (gens()[index] & 1) != 0; }
+        T* slot(size_t index) const { 
+            return reinterpret_cast<T*>(slots()[index].mem); 
+        }
+        const AllocStats& stats() const { return m_stats; }
+    private:
+        union Slot {
+            uint32_t next; // index of the next free slot
+            char mem[sizeof(T)];
+        };
+        enum { NO_SLOT = 0xffffffff };
+        HandlePool(const HandlePool&);
+        HandlePool& operator=(const HandlePool&);
+        Slot* slots() const { return reinterpret_cast<Slot*>(m_slots.base()); }
+        uint32_t* gens() const { 
+            return reinterpret_cast<uint32_t*>(m_gens.base()); 
+        }
+        /// append index to the free list
+        void release(uint32_t index);
+        void grow();
+        const char* m_name;
+        size_t m_maxSlots;
+        size_t m_increment;
+        VirtualRange m_slots;
+        VirtualRange m_gens; // generation of each slot
+        size_t m_capacity;
+        uint32_t m_free; // head of the free list, taken by alloc()
+        uint32_t m_freeTail; // freed slots go behind it
+        AllocCounters m_stats;
     };
 
     /// microseconds since 1970/01/01 stored in 64-bit integer. 
@@ -126,6 +555,10 @@ namespace ate {
             return *this;
         }
         
+        /// monotonic time of NanoTime::monotonic(), used by timed waits 
+        /// and timers
+        inline static MicroTime monotonic();
+
         static MicroTime now() {
             struct timeval tv;
             MicroTime mt;
@@ -137,6 +570,87 @@ namespace ate {
         
     };
 
+    /// nanoseconds stored in 64-bit integer, since 1970/01/01 for wall 
+    /// time or since an unspecified point for monotonic time. 
+    struct NanoTime {
+        uint64_t nanosec;
+
+        NanoTime(): nanosec((uint64_t)-1) {}
+        explicit NanoTime(uint64_t ns): nanosec(ns) {}
+        void setMax() { nanosec = (uint64_t)-1; }
+        void setMin() { nanosec = 0; }
+        bool isMax() const { return nanosec == (uint64_t)-1; }
+        bool isMin() const { return nanosec == 0; }
+        inline NanoTime& add(int millisec) {
+            nanosec += millisec * (uint64_t)1000000;
+            return *this;
+        }
+        MicroTime toMicroTime() const {
+            MicroTime mt;
+            mt.microsec = isMax() ? (uint64_t)-1 : nanosec / 1000;
+            return mt;
+        }
+        /// wall time 
+        inline static NanoTime now();
+        /// monotonic time, never goes back
+        inline static NanoTime monotonic();
+        /// monotonic time of the last Clock::update() in this thread
+        inline static NanoTime cached();
+    };
+
+    /**
+     * Clock turns the TSC into nanoseconds: ticks since the last resync are 
+     * scaled by mult >> shift and added to the clock values read at the 
+     * resync. The scale is calibrated against CLOCK_MONOTONIC on first use
+     * and corrected at every resync (once a second), which also rebases the
+     * monotonic time on CLOCK_MONOTONIC, so it does not drift. The base is 
+     * published with a sequence lock. Without an invariant TSC, 
+     * clock_gettime() is used instead.
+     */
+    class Clock {
+    public:
+        /// calibrate the TSC, done on first use
+        static void calibrate();
+        /// true if times are computed from the TSC
+        static bool tsc();
+        /// TSC frequency, 0 without TSC
+        static uint64_t ticksPerSecond();
+        /// refresh and return NanoTime::cached(), EventLoop calls it on
+        /// every cycle
+        static NanoTime update() { 
+            s_cached = read(false);
+            return NanoTime(s_cached); 
+        }
+        /// wall time of a monotonic time
+        static NanoTime toWall(const NanoTime& mono);
+        /// CLOCK_MONOTONIC time of a monotonic deadline, for the kernel. 
+        /// The two clocks are read now, so a deadline does not move with 
+        /// the error of the TSC scale.
+        static timespec toSystem(const MicroTime& mono);
+    private:
+        friend struct NanoTime;
+        struct Base {
+            volatile int seq; // odd while the base is updated
+            bool tsc;
+            uint32_t mult;
+            uint32_t shift;
+            uint64_t ticks; // TSC at the last resync
+            uint64_t mono;  // CLOCK_MONOTONIC nanoseconds at ticks
+            uint64_t wall;  // wall nanoseconds at ticks
+            uint64_t resyncTicks; // 0 forces the slow path
+            uint64_t floor; // monotonic read() never returns less
+        };
+        /// ticks * mult >> shift without 64-bit overflow, shift <= 32
+        static uint64_t scale(uint64_t ticks, uint32_t mult, uint32_t shift) {
+            return (((ticks >> 32) * mult) << (32 - shift)) + 
+                (((ticks & 0xffffffff) * mult) >> shift);
+        }
+        inline static uint64_t read(bool wall);
+        static uint64_t readSlow(bool wall);
+        static Base s_base;
+        static __thread uint64_t s_cached;
+    };
+
     class Thread {
     public: 
         Thread(bool joinable = false);
@@ -149,6 +663,11 @@ namespace ate {
         pthread_t id() { return m_id; }
         
         static void sleep(unsigned int millis); 
+        /// how late the kernel may wake the calling thread from timed waits
+        /// to batch wakeups, 50 us by default 
+        static void setTimerSlack(unsigned long nanos);
+        /// run the calling thread on the given cpu only
+        static void setAffinity(int cpu);
         inline static void yield() { ATE_ASSERT(sched_yield() == 0); }
         inline static pthread_t currentId() { return pthread_self(); }
     private:
@@ -163,6 +682,10 @@ namespace ate {
         ~SpinLock() {}
         void lock();
         void unlock();
+        /// return true if the lock is acquired, never blocks
+        bool tryLock() { 
+            return m_lock.locked == 0 && testAndSet(&m_lock.locked) == 0;
+        }
     private:
         volatile union { 
             volatile int locked;
@@ -170,6 +693,67 @@ namespace ate {
         } m_lock;
     };
 
+    /**
+     * TicketLock grants the lock in arrival order, so no thread starves.
+     * The ticket dispenser and the now serving counter are on their own
+     * cache lines. Waiters yield the cpu after a short spin.
+     */
+    class TicketLock {
+    public:
+        TicketLock() : m_next(0), m_serving(0) {}
+        void lock();
+        void unlock() {
+            releaseFence();
+            m_serving = m_serving + 1;
+        }
+        /// return true if the lock is acquired, never blocks
+        bool tryLock() {
+            int serving = m_serving;
+            return m_next == serving && 
+                cmpAndSwap(&m_next, serving, serving + 1) == serving;
+        }
+    private:
+        char m_pad0[CACHE_LINE_SIZE];
+        volatile int m_next;
+        char m_pad1[CACHE_LINE_SIZE - sizeof(int)];
+        volatile int m_serving;
+        char m_pad2[CACHE_LINE_SIZE - sizeof(int)];
+    };
+
+    /**
+     * McsLock queues waiters in a list of nodes, every waiter spins on its 
+     * own node and the lock is handed over in arrival order. The nodes come
+     * from a small per-thread stack, so a thread can hold up to 
+     * MAX_HELD locks at once and the lock works with LockGuard.
+     */
+    class McsLock {
+    public:
+        enum { MAX_HELD = 8 };
+        McsLock() : m_tail(NULL), m_owner(NULL) {}
+        void lock();
+        void unlock();
+        /// return true if the lock is acquired, never blocks
+        bool tryLock();
+    private:
+        struct Node {
+            Node* volatile next;
+            volatile int locked;
+            Node* free; // next in the free stack of the thread
+        } __attribute__((aligned(CACHE_LINE_SIZE)));
+        static Node* allocNode();
+        static void freeNode(Node* node) {
+            node->free = s_free;
+            s_free = node;
+        }
+        char m_pad0[CACHE_LINE_SIZE];
+        Node* volatile m_tail;
+        Node* m_owner; // written by the holder only
+        char m_pad1[CACHE_LINE_SIZE - 2 * sizeof(Node*)];
+        static __thread Node s_nodes[MAX_HELD];
+        static __thread Node* s_free;
+        static __thread bool s_init;
+    };
+
     class Mutex {
     public:
         friend class Condition;
@@ -190,7 +774,245 @@ namespace ate {
     private:
         Lockable& m_lock;
     };
+
+    template <typename Lockable>
+    class ReadGuard {
+    public:
+        ReadGuard(Lockable& lock) : m_lock(lock) { m_lock.readLock(); }
+        ~ReadGuard() { m_lock.readUnlock(); }
+    private:
+        Lockable& m_lock;
+    };
+
+    /**
+     * RWSpinLock lets many readers in at once and prefers writers: a 
+     * waiting writer stops new readers from entering. lock()/unlock() are
+     * the write side, so it works with LockGuard, and ReadGuard takes the
+     * read side.
+     */
+    class RWSpinLock {
+    public:
+        RWSpinLock() : m_state(0) {}
+        void lock();
+        void unlock() { fetchAndSub(&m_state, WRITER); }
+        void readLock() {
+            int state = m_state;
+            if ((state & (WRITER | WAITING)) != 0 || 
+                cmpAndSwap(&m_state, state, state + READER) != state)
+                readLockSlow();
+        }
+        void readUnlock() { fetchAndSub(&m_state, READER); }
+    private:
+        enum { WRITER = 1, WAITING = 2, READER = 4 };
+        void readLockSlow();
+        char m_pad0[CACHE_LINE_SIZE];
+        volatile int m_state; // readers * READER | WAITING | WRITER
+        char m_pad1[CACHE_LINE_SIZE - sizeof(int)];
+    };
+
+    /**
+     * SeqLock publishes a small POD value to many readers. Readers never 
+     * write to the lock: load() copies the value and retries if a writer
+     * changed it meanwhile. Writers update with store(), or change value()
+     * in place between lock() and unlock() (e.g. LockGuard).
+     */
+    template <typename T>
+    class SeqLock {
+    public:
+        SeqLock() : m_seq(0) {}
+        explicit SeqLock(const T& value) : m_seq(0), m_value(value) {}
+        inline T load() const;
+        void store(const T& value) {
+            lock();
+            m_value = value;
+            unlock();
+        }
+        inline void lock();
+        void unlock() {
+            releaseFence();
+            m_seq = m_seq + 1;
+        }
+        /// the value to change while locked
+        T& value() { return m_value; }
+    private:
+        char m_pad0[CACHE_LINE_SIZE];
+        volatile int m_seq; // odd while a writer holds the lock
+        T m_value;
+    };
     
+    /**
+     * CachedPool is a thread safe Pool for objects that are allocated in 
+     * one thread and released in another. Each thread allocates from its 
+     * own cache and refills it by a batch of blocks from the shared Region.
+     * A block always goes back to the cache that allocated it: the owner 
+     * thread frees to its local list, other threads push the block to the 
+     * owner's remote list without locking. The owner takes the whole remote 
+     * list in one swap when its local list runs empty. 
+     * The cache of a thread that exits is adopted by the next new thread.
+     */
+    template <typename T>
+    class CachedPool {
+    public:
+        CachedPool(const char* name = "CachedPool", size_t batchBlocks = 256);
+        /// return a pointer to a T object
+        inline T* alloc();
+        /// ptr has to be from CachedPool.alloc() of any thread
+        inline void dealloc(T* ptr);
+        /// destructor releases all allocated memory 
+        ~CachedPool();
+    private:
+        struct Cache;
+        struct Block {
+            Cache* owner;
+            union {
+                Block* next;
+                char mem[sizeof(T)];
+            } u;
+        };
+        struct Cache {
+            Block* head; // local free list, only touched by the owner
+            size_t size; // blocks carved for this cache
+            Cache* next; // all caches of the pool
+            CachedPool* pool;
+            bool orphaned; // owner thread has exited, protected by m_lock
+            char padding[CACHE_LINE_SIZE];
+            Block* volatile remote; // freed by other threads
+        };
+        CachedPool(const CachedPool&);
+        CachedPool& operator=(const CachedPool&);
+        Cache* getCache();
+        Block* refill(Cache* cache);
+        static void orphan(void* cache);
+        const char* m_name;
+        size_t m_batch;
+        pthread_key_t m_key;
+        SpinLock m_lock; // protects m_region, m_caches and m_stats
+        Region m_region;
+        Cache* m_caches;
+        AllocCounters m_stats; // inUse and peak are not counted
+    };
+
+    /**
+     * ConcurrentPool is a lock free Pool shared by multiple threads. 
+     * The free list is a Treiber stack whose head pointer carries a tag 
+     * that changes on every update, so a pop never swaps in a stale next 
+     * pointer when the head block was recycled in between (ABA). 
+     * When the list runs empty, one thread grows it from the Region and 
+     * pushes the new blocks in one step while the others wait for them.
+     */
+    template <typename T>
+    class ConcurrentPool {
+    public:
+        union Block {
+            Block* next;
+            char mem[sizeof(T)];
+        };
+        ConcurrentPool(const char* name = "ConcurrentPool", 
+                       size_t initBlocks = 128, 
+                       size_t maxIncrement = 1024,
+                       const RegionPolicy& policy = RegionPolicy());
+        /// return a pointer to a T object
+        inline T* alloc();
+        /// put memory back to free list. ptr has to be from alloc() 
+        inline void dealloc(T* ptr);
+        /// dealloc() n blocks with one swap of the free list head
+        void deallocBulk(size_t n, T* const* ptrs);
+        /// destructor releases all allocated memory 
+        ~ConcurrentPool() {}
+    private:
+        ConcurrentPool(const ConcurrentPool&);
+        ConcurrentPool& operator=(const ConcurrentPool&);
+        void grow(size_t nBlocks);
+        void push(Block* first, Block* last);
+        volatile TaggedPtr m_head;
+        char m_padding[CACHE_LINE_SIZE]; // keep m_head apart from the rest
+        SpinLock m_growLock; // only the growing thread touches m_region 
+        const char* m_name;
+        Region m_region;
+        size_t m_maxIncr;
+        size_t m_size;
+        AllocCounters m_stats; // inUse and peak are not counted
+    };
+
+    /**
+     * BinAllocator is a standard allocator drawing from a Bin. deallocate()
+     * does nothing, memory comes back when the Bin is rewound or destroyed.
+     */
+    template <typename T>
+    class BinAllocator {
+    public:
+        typedef T value_type;
+        typedef T* pointer;
+        typedef const T* const_pointer;
+        typedef T& reference;
+        typedef const T& const_reference;
+        typedef size_t size_type;
+        typedef ptrdiff_t difference_type;
+        template <typename U> struct rebind { 
+            typedef BinAllocator<U> other; 
+        };
+        BinAllocator(Bin& bin) : m_bin(&bin) {}
+        template <typename U> 
+        BinAllocator(const BinAllocator<U>& a) : m_bin(a.bin()) {}
+        pointer address(reference x) const { return &x; }
+        const_pointer address(const_reference x) const { return &x; }
+        pointer allocate(size_type n, const void* = 0) {
+            return static_cast<pointer>(m_bin->alloc(n * sizeof(T), false));
+        }
+        void deallocate(pointer, size_type) {}
+        size_type max_size() const { return ((size_t)-1) / sizeof(T); }
+        void construct(pointer p, const T& val) { new(p) T(val); }
+        void destroy(pointer p) { p->~T(); }
+        Bin* bin() const { return m_bin; }
+    private:
+        Bin* m_bin;
+    };
+
+    /**
+     * PoolAllocator is a standard allocator for node based containers, 
+     * e.g. std::map and std::list. Single object requests come from a 
+     * CachedPool shared by all PoolAllocators of the same type, so nodes 
+     * may be freed by any thread. Arrays come from operator new.
+     */
+    template <typename T>
+    class PoolAllocator {
+    public:
+        typedef T value_type;
+        typedef T* pointer;
+        typedef const T* const_pointer;
+        typedef T& reference;
+        typedef const T& const_reference;
+        typedef size_t size_type;
+        typedef ptrdiff_t difference_type;
+        template <typename U> struct rebind { 
+            typedef PoolAllocator<U> other; 
+        };
+        PoolAllocator() {}
+        template <typename U> PoolAllocator(const PoolAllocator<U>&) {}
+        pointer address(reference x) const { return &x; }
+        const_pointer address(const_reference x) const { return &x; }
+        pointer allocate(size_type n, const void* = 0) {
+            if (n == 1)
+                return pool().alloc();
+            return static_cast<pointer>(::operator new(n * sizeof(T)));
+        }
+        void deallocate(pointer p, size_type n) {
+            if (n == 1)
+                pool().dealloc(p);
+            else 
+                ::operator delete(p);
+        }
+        size_type max_size() const { return ((size_t)-1) / sizeof(T); }
+        void construct(pointer p, const T& val) { new(p) T(val); }
+        void destroy(pointer p) { p->~T(); }
+    private:
+        static CachedPool<T>& pool() {
+            // never destroyed: static containers may outlive it otherwise
+            static CachedPool<T>* s_pool = new CachedPool<T>("PoolAllocator");
+            return *s_pool;
+        }
+    };
+
     // Condition Variable 
     class Condition {
     public:
@@ -200,12 +1022,11 @@ namespace ate {
             ATE_ASSERT(pthread_cond_wait(&m_cond, &mutex.m_mutex) == 0);
             return 0; // always return 0
         }
+        /// mt is a monotonic time, see MicroTime::monotonic()
         int timedWait(Mutex& mutex, const MicroTime& mt) {
             if (mt.isMax())
                 return wait(mutex);
-            struct timespec abstime;
-            abstime.tv_sec = mt.microsec / 1000000; 
-            abstime.tv_nsec = (mt.microsec % 1000000) * 1000;
+            struct timespec abstime = Clock::toSystem(mt);
             int rc = pthread_cond_timedwait(&m_cond, &mutex.m_mutex, &abstime);
             ATE_ASSERT(rc == 0 || rc == ETIMEDOUT);
             return rc; // todo: enum timeout
@@ -217,11 +1038,71 @@ namespace ate {
         pthread_cond_t m_cond;
     };
     
+    /**
+     * FastMutex is a futex: 0 unlocked, 1 locked, 2 locked with parked 
+     * waiters. lock() takes a free mutex with one CAS and spins a bounded 
+     * time on a multi-cpu machine before it parks; unlock() makes the wake 
+     * syscall only when a waiter may be parked.
+     */
+    class FastMutex {
+    public:
+        FastMutex() : m_state(0) {}
+        void lock() {
+            if (cmpAndSwap(&m_state, 0, 1) != 0)
+                lockSlow();
+        }
+        void unlock() {
+            if (fetchAndSub(&m_state, 1) != 1)
+                unlockSlow();
+        }
+        /// return true if the lock is acquired, never blocks
+        bool tryLock() { return cmpAndSwap(&m_state, 0, 1) == 0; }
+    private:
+        FastMutex(const FastMutex&);
+        FastMutex& operator=(const FastMutex&);
+        void lockSlow();
+        void unlockSlow();
+        volatile int m_state;
+    };
+
+    /**
+     * FastCondition is a futex on a sequence number that notify() bumps. 
+     * notify() does nothing when no thread waits. 
+     * Like Condition, wakeups may be spurious.
+     */
+    class FastCondition {
+    public:
+        FastCondition() : m_seq(0), m_waiters(0) {}
+        int wait(FastMutex& mutex) { 
+            timedWait(mutex, MicroTime());
+            return 0; // always return 0
+        }
+        /// mt is a monotonic time, see MicroTime::monotonic()
+        int timedWait(FastMutex& mutex, const MicroTime& mt);
+        /// waiters count themselves under the mutex, so a notify() with 
+        /// the mutex held sees them
+        void notify() {
+            if (m_waiters != 0)
+                wake(1);
+        }
+        void notifyAll() {
+            if (m_waiters != 0)
+                wake(-1);
+        }
+    private:
+        FastCondition(const FastCondition&);
+        FastCondition& operator=(const FastCondition&);
+        void wake(int count);
+        volatile int m_seq;
+        volatile int m_waiters;
+    };
+    
     // Monitor = mutex + conditional variable
-    class Monitor {
+    template <typename MutexType, typename ConditionType>
+    class BasicMonitor {
     public:
-        Monitor() {}
-        ~Monitor() {}
+        BasicMonitor() {}
+        ~BasicMonitor() {}
         void lock() { m_mutex.lock(); }
         void unlock() { m_mutex.unlock(); }
         int wait() { return m_cond.wait(m_mutex); }
@@ -231,9 +1112,11 @@ namespace ate {
         void notify() { m_cond.notify(); }
         void notifyAll() { m_cond.notifyAll(); }
     private:
-        Mutex m_mutex;
-        Condition m_cond;
+        MutexType m_mutex;
+        ConditionType m_cond;
     };
+    typedef BasicMonitor<FastMutex, FastCondition> Monitor;
+    typedef BasicMonitor<Mutex, Condition> PthreadMonitor;
     
     /// SignalManager is a singleton. 
     /// init() should be called at the beginning of main thead. 
@@ -253,36 +1136,105 @@ namespace ate {
     struct Timer;
     typedef bool (*TimerCallback)(const Timer& timer);    
     struct Timer {
-        MicroTime time;
+        MicroTime time; // monotonic, see MicroTime::monotonic()
         int increment; // in milliseconds         
         TimerCallback tcb;
         void* aux;
     };
 
-    // Timer priority queue, it is suitable for small number of timers. 
+    /**
+     * TimerQueue is a hierarchical timing wheel: add, remove and expire 
+     * are O(1) for any number of timers. A timer expires in the first 
+     * 16 us tick at or after its time, so it fires at most one tick late.
+     * Level k has 64 slots of 64^k ticks. A timer goes to the level of 
+     * the highest 6-bit group where its tick differs from the current 
+     * tick, and moves down a level when the wheel reaches its slot. 10 
+     * levels cover the whole 64-bit MicroTime, so there is no overflow 
+     * list. Only post() is thread safe.
+     */
     class TimerQueue {
     public:        
-        TimerQueue(const char* name = "TimerQueue")
-            : m_name(name), m_pool(m_name) {
-            m_dummy.prev = m_dummy.next = &m_dummy; 
-        }
-        const MicroTime& minTime() const { return m_dummy.next->timer.time; }
-        void add(const Timer& timer);
+        /// stale once the timer is done or cancelled. The pool handle in 
+        /// the low 32 bits, a sequence number of the add() in the high 32 
+        /// bits, so a stale handle never matches a timer that reuses its slot
+        typedef uint64_t Handle;
+        enum { DEFAULT_MAX_TIMERS = 1 << 20 };
+        /// maxTimers live timers at most, their nodes are reserved as 
+        /// address space up front
+        TimerQueue(const char* name = "TimerQueue", 
+                   size_t maxTimers = DEFAULT_MAX_TIMERS);
+        /// a lower bound of the next expiry, max if there is no timer. 
+        /// It is exact for timers in the next 64 ticks.
+        MicroTime minTime() const;
+        Handle add(const Timer& timer);
+        /// false if h is stale. A callback may cancel its own timer.
+        bool cancel(Handle h);
+        /// move the timer to time, false if h is stale. When a callback 
+        /// reschedules its own timer, the return value of the callback is
+        /// ignored.
+        bool reschedule(Handle h, const MicroTime& time);
         void dispatch(const MicroTime& now);
+        size_t size() const { return m_count; }
+        /// how late timers fire: now of dispatch() minus the timer time
+        struct Stats {
+            uint64_t fired;
+            uint64_t lateMicros; // sum over the fired timers
+            uint64_t maxLateMicros;
+        };
+        const Stats& stats() const { return m_stats; }
+        /// lock free, the timer is added by the next addPosted(). Return 
+        /// true if no other posted timer is waiting for it.
+        bool post(const Timer& timer);
+        bool hasPosted() const { return m_posted != NULL; }
+        /// add the posted timers in the order they were posted
+        void addPosted();
     private:
-        struct TimerNode {
-            TimerNode* next;
+        enum {
+            TICK_SHIFT = 4, // 16 us ticks
+            SLOT_BITS = 6,
+            SLOTS = 1 << SLOT_BITS,
+            LEVELS = 10, // (64 - TICK_SHIFT) / SLOT_BITS
+            // TimerNode::slot of a timer in its callback
+            FIRING = LEVELS * SLOTS,
+            CANCELLED,
+            RESCHEDULED
+        };
+        struct Link {
+            Link* next;
+            Link* prev;
+        };
+        struct TimerNode : Link {
+            Timer timer;
+            uint64_t tick; // expiry tick
+            size_t slot; // level * SLOTS + slot in the level
+            uint32_t seq; // high 32 bits of its Handle
+        };
+        struct PostedTimer {
+            PostedTimer* next;
             Timer timer;
-            TimerNode* prev;
         };
         const char* m_name;
-        Pool<TimerNode> m_pool;
-        TimerNode m_dummy; // dummy node for both head and tail         
-        void doAdd(TimerNode* newNode);
+        HandlePool<TimerNode> m_pool;
+        PostedTimer* volatile m_posted; // LIFO, addPosted() takes them all
+        ConcurrentPool<PostedTimer> m_postedPool;
+        Link m_slots[LEVELS * SLOTS]; // circular lists
+        uint64_t m_occupied[LEVELS]; // bit i: slot i is not empty
+        uint64_t m_tick; // every timer expires at or after this tick
+        size_t m_count;
+        Stats m_stats;
+        uint32_t m_seq; // of the last add()
+        void link(TimerNode* node);
+        void unlink(TimerNode* node);
+        /// the node of h, NULL if h is stale
+        TimerNode* find(Handle h) const;
+        /// the first non-empty slot, false if there is no timer
+        bool nextSlot(size_t& level, size_t& slot, uint64_t& tick) const;
     };
     
+    typedef TimerQueue::Handle TimerHandle;
+
     // FastQueue is for one/multiple producer, ONE consumer
-    class EventLoop;
+    template <typename Queue> class BasicEventLoop;
     template<typename T>
     class FastQueue {
     public:
@@ -290,15 +1242,108 @@ namespace ate {
             Node* next; // have to be first since it will be Pool<T>::Block
             T obj;
         };
-        friend class EventLoop;
+        template <typename Queue> friend class BasicEventLoop;
+        /// what a push does when a bounded queue is full
+        enum Overflow {
+            BLOCK,       // wait until the consumer takes the queued batch
+            FAIL,        // return false, same as tryPush()
+            DROP_OLDEST, // discard the oldest queued element
+            DROP_NEWEST  // discard the pushed element
+        };
+        struct OverflowStats {
+            size_t blocked;  // pushes that had to wait
+            size_t rejected; // pushes that failed
+            size_t dropped;  // elements discarded by DROP_OLDEST/NEWEST
+        };
+        /// called with high = true when the queue reaches the high-water
+        /// mark and with false once the consumer takes it. It is called 
+        /// with the queue locked, so it must not push to this queue.
+        typedef void (*HighWaterCallback)(bool high, void* aux);
         FastQueue(Monitor& monitor, const char* name = "FastQueue", 
-                  size_t initNodes = 128, size_t maxIncrement = 1024) 
-            : m_monitor(monitor), m_name(name), m_maxIncr(maxIncrement),
-              m_size(0), m_wtail(&m_whead), m_rhead(NULL), m_rtail(NULL) {
+                  size_t initNodes = 128, size_t maxIncrement = 1024,
+                  const RegionPolicy& policy = RegionPolicy()) 
+            : m_monitor(monitor), m_name(name), m_region(policy), 
+              m_maxIncr(maxIncrement),
+              m_size(0), m_wtail(&m_whead), m_rhead(NULL), m_rtail(NULL),
+              m_wcount(0), m_rcount(0), m_stats(name), m_capacity(0),
+              m_overflow(BLOCK), m_blocking(0), m_highMark(0), 
+              m_highCallback(NULL), m_highAux(NULL), m_aboveHigh(false) {
+            m_overflowStats.blocked = 0;
+            m_overflowStats.rejected = 0;
+            m_overflowStats.dropped = 0;
             grow(initNodes);
         }
-        void push(const T& elem);
+        ~FastQueue();
+        /// bound the queued elements, 0 for an unbounded queue. At most
+        /// 2 * capacity nodes are used: the queued ones and the batch 
+        /// being consumed.
+        void setCapacity(size_t capacity, Overflow overflow = BLOCK);
+        /// call callback when the queue holds mark elements, 0 for none
+        void setHighWater(size_t mark, HighWaterCallback callback, 
+                          void* aux = NULL);
+        /// false if the element is rejected or dropped by the policy
+        bool push(const T& elem);
+        /// push without blocking, false if a bounded queue is full
+        bool tryPush(const T& elem);
+        /// push [first, last) with one lock, the overflow policy applies
+        /// to each element
+        template <typename InputIterator>
+        void pushN(InputIterator first, InputIterator last);
+        /// push T(args...) constructed in the queue node
+        bool emplace() { 
+            void* p = pushSlot(m_overflow);
+            if (p == NULL)
+                return false;
+            new(p) T(); 
+            pushDone(); 
+            return true;
+        }
+        template <typename A1> 
+        bool emplace(const A1& a1) { 
+            void* p = pushSlot(m_overflow);
+            if (p == NULL)
+                return false;
+            new(p) T(a1); 
+            pushDone(); 
+            return true;
+        }
+        template <typename A1, typename A2> 
+        bool emplace(const A1& a1, const A2& a2) { 
+            void* p = pushSlot(m_overflow);
+            if (p == NULL)
+                return false;
+            new(p) T(a1, a2); 
+            pushDone(); 
+            return true;
+        }
+        template <typename A1, typename A2, typename A3> 
+        bool emplace(const A1& a1, const A2& a2, const A3& a3) { 
+            void* p = pushSlot(m_overflow);
+            if (p == NULL)
+                return false;
+            new(p) T(a1, a2, a3); 
+            pushDone(); 
+            return true;
+        }
+        template <typename A1, typename A2, typename A3, typename A4> 
+        bool emplace(const A1& a1, const A2& a2, const A3& a3, const A4& a4) {
+            void* p = pushSlot(m_overflow);
+            if (p == NULL)
+                return false;
+            new(p) T(a1, a2, a3, a4); 
+            pushDone(); 
+            return true;
+        }
+        /// NULL if abstime passes or the monitor is notified while empty.
+        /// The elements are destroyed on the next getWork().
         inline Node* getWork(const MicroTime& abstime);        
+        /// the consumer may poll it without the monitor
+        bool empty() const { 
+            return *const_cast<Node* const volatile*>(&m_wtail) == &m_whead; 
+        }
+        /// inUse counts nodes queued or being consumed
+        const AllocStats& stats() const { return m_stats; }
+        const OverflowStats& overflowStats() const { return m_overflowStats; }
     private:
         Monitor& m_monitor; 
         const char* m_name;
@@ -309,8 +1354,42 @@ namespace ate {
         Node* m_wtail;
         Node* m_rhead;
         Node* m_rtail;
+        size_t m_wcount; // nodes in the write queue
+        size_t m_rcount; // nodes in the read queue
+        AllocCounters m_stats;
         MicroTime m_waitTime;
+        size_t m_capacity; // 0 for unbounded
+        Overflow m_overflow;
+        size_t m_blocking; // producers waiting for room
+        OverflowStats m_overflowStats;
+        size_t m_highMark;
+        HighWaterCallback m_highCallback;
+        void* m_highAux;
+        bool m_aboveHigh;
         void grow(size_t nNodes); 
+        /// lock and return the memory of the next element, or unlock and 
+        /// return NULL if a full queue refuses it
+        inline void* pushSlot(Overflow overflow);
+        /// queue the element constructed in pushSlot() and unlock
+        inline void pushDone();
+        /// make room in a full queue, false if the element is refused
+        bool makeRoom(Overflow overflow);
+        /// call the high-water callback once the queue is at or above 
+        /// the mark, again only after the consumer took the queue
+        void checkHighWater() {
+            if (m_highMark != 0 && m_wcount >= m_highMark && !m_aboveHigh) {
+                m_aboveHigh = true;
+                m_highCallback(true, m_highAux);
+            }
+        }
+        /// link a free node after the tail and return it
+        Node* nextFree() {
+            if (m_wtail->next == NULL) { // no more free nodes
+                size_t increment = m_size < m_maxIncr ? m_size : m_maxIncr;
+                grow(increment);
+            } 
+            return m_wtail->next;
+        }
         Node* getWorkWithLock(const MicroTime& abstime); 
     };
     
@@ -320,6 +1399,9 @@ namespace ate {
         int len;
         void* data;
         EventHandler* handler; // make sure this is not NULL when created
+        Event() {}
+        Event(int t, int l, void* d, EventHandler* h)
+            : type(t), len(l), data(d), handler(h) {}
     };
     
     class EventHandler {
@@ -327,27 +1409,306 @@ namespace ate {
         virtual void onEvent(Event& event) = 0;
         virtual ~EventHandler() {}
     };
+    /**
+     * MpscQueue is a lock-free multi-producer/single-consumer queue of 
+     * intrusive nodes (Vyukov): push() swaps itself into the tail with one 
+     * exchange and links the previous tail. The consumer takes the whole 
+     * queue as a batch by pushing the stub node behind it, the nodes of the
+     * batch are recycled to a ConcurrentPool on the next getWork(). 
+     * Producers touch the Monitor only to wake a parked consumer, on the 
+     * empty to non-empty transition.
+     */
+    template<typename T>
+    class MpscQueue {
+    public:
+        struct Node {
+            Node* volatile next;
+            T obj;
+        };
+        template <typename Queue> friend class BasicEventLoop;
+        MpscQueue(Monitor& monitor, const char* name = "MpscQueue", 
+                  size_t initNodes = 128, size_t maxIncrement = 1024,
+                  const RegionPolicy& policy = RegionPolicy()) 
+            : m_tail(&m_stub), m_monitor(monitor), 
+              m_pool(name, initNodes, maxIncrement, policy), 
+              m_waiting(0), m_batch(NULL) {
+            m_stub.next = NULL;
+        }
+        ~MpscQueue();
+        void push(const T& elem);
+        /// push [first, last) with one exchange and at most one notify
+        template <typename InputIterator>
+        void pushN(InputIterator first, InputIterator last);
+        /// push T(args...) constructed in the queue node
+        void emplace() { pushNode(new(allocNode()) T()); }
+        template <typename A1> 
+        void emplace(const A1& a1) { pushNode(new(allocNode()) T(a1)); }
+        template <typename A1, typename A2> 
+        void emplace(const A1& a1, const A2& a2) { 
+            pushNode(new(allocNode()) T(a1, a2));
+        }
+        template <typename A1, typename A2, typename A3> 
+        void emplace(const A1& a1, const A2& a2, const A3& a3) { 
+            pushNode(new(allocNode()) T(a1, a2, a3));
+        }
+        template <typename A1, typename A2, typename A3, typename A4> 
+        void emplace(const A1& a1, const A2& a2, const A3& a3, const A4& a4) {
+            pushNode(new(allocNode()) T(a1, a2, a3, a4));
+        }
+        /// NULL if abstime passes or the monitor is notified while empty.
+        /// The elements are destroyed on the next getWork().
+        inline Node* getWork(const MicroTime& abstime);        
+        /// the consumer may poll it without the monitor
+        bool empty() const { return m_tail == &m_stub; }
+    private:
+        MpscQueue(const MpscQueue&);
+        MpscQueue& operator=(const MpscQueue&);
+        /// link the chain first..last behind the tail, return the previous
+        /// tail
+        Node* link(Node* first, Node* last) {
+            last->next = NULL;
+            Node* prev = static_cast<Node*>(fetchAndStorePtr(
+                reinterpret_cast<void* volatile*>(&m_tail), last));
+            prev->next = first;
+            return prev;
+        }
+        Node* link(Node* node) { return link(node, node); }
+        /// the obj memory of a new node
+        void* allocNode() { return &m_pool.alloc()->obj; }
+        /// link the node of obj and wake up the consumer if needed
+        inline void pushNode(T* obj);
+        void recycle(Node* batch);
+        Node* takeBatch();
+        Node* getWorkWithLock(const MicroTime& abstime); 
+        Node* volatile m_tail; // written by producers
+        char m_padding[CACHE_LINE_SIZE]; 
+        Node m_stub; // the head, the batch ends where it is pushed again
+        Monitor& m_monitor; 
+        ConcurrentPool<Node> m_pool;
+        volatile int m_waiting; // the consumer is parked
+        Node* m_batch; // nodes given to the consumer last time
+    };
+
+    /**
+     * SpscRing is a bounded single-producer/single-consumer ring of 
+     * power-of-two capacity. The consumer index (head) and the producer 
+     * index (tail) live on separate cache lines, and each side keeps a 
+     * cached copy of the other side's index, so it reads the shared one 
+     * only when the ring looks full or empty. Elements are copy 
+     * constructed into the slots and destroyed when popped.
+     */
+    template <typename T>
+    class SpscRing {
+    public:
+        /// capacity is rounded up to a power of two
+        SpscRing(size_t capacity, const RegionPolicy& policy = RegionPolicy());
+        ~SpscRing();
+        size_t capacity() const { return m_mask + 1; }
+        /// producer: false if the ring is full
+        bool tryPush(const T& elem) { return tryPushN(&elem, &elem + 1) == 1; }
+        /// producer: push elements from [first, last) until the ring is 
+        /// full, return the number pushed
+        template <typename InputIterator>
+        size_t tryPushN(InputIterator first, InputIterator last);
+        /// consumer: false if the ring is empty
+        bool tryPop(T& elem) { return tryPopN(&elem, 1) == 1; }
+        /// consumer: pop up to n elements to out, return the number popped
+        template <typename OutputIterator>
+        size_t tryPopN(OutputIterator out, size_t n);
+        /// either side, exact only on the consumer side
+        bool empty() const { return m_head == m_tail; }
+    private:
+        SpscRing(const SpscRing&);
+        SpscRing& operator=(const SpscRing&);
+        char m_pad0[CACHE_LINE_SIZE];
+        // consumer side
+        volatile size_t m_head;
+        size_t m_tailCache;
+        char m_pad1[CACHE_LINE_SIZE - 2 * sizeof(size_t)];
+        // producer side
+        volatile size_t m_tail;
+        size_t m_headCache;
+        char m_pad2[CACHE_LINE_SIZE - 2 * sizeof(size_t)];
+        size_t m_mask;
+        T* m_slots;
+        Region m_region;
+    };
+
     typedef FastQueue<Event> EventQueue; 
     typedef EventQueue::Node EventNode;
+    typedef SpscRing<Event> EventRing;
+    typedef MpscQueue<Event> MpscEventQueue; 
     
-    class EventLoop {
+    /**
+     * BasicEventLoop dispatches timers and events from a Queue of Events,
+     * FastQueue (EventLoop) or MpscQueue (MpscEventLoop). It is 
+     * instantiated for these two in EventLoop.cpp.
+     */
+    template <typename Queue>
+    class BasicEventLoop {
     public:
-        EventLoop();
-        virtual ~EventLoop() {}
+        typedef typename Queue::Node Node;
+        /// how run() waits when there is no work
+        enum WaitStrategy {
+            BLOCK,          // wait on the monitor, the default
+            BUSY_SPIN,      // spin with cpuPause(), never wait
+            SPIN_YIELD_PARK // spin, then yield, then wait on the monitor
+        };
+        /// maxTimers: see TimerQueue
+        BasicEventLoop(size_t maxTimers = TimerQueue::DEFAULT_MAX_TIMERS);
+        virtual ~BasicEventLoop() {}
         void push(const Event& event);
-        void addTimer(const Timer& timer);//NOT thread safe: require loop thread
+        /// push [first, last) with one lock and at most one wakeup
+        template <typename InputIterator>
+        void pushN(InputIterator first, InputIterator last) { 
+            m_evq.pushN(first, last); 
+        }
+        /// push an Event constructed in the queue
+        void emplace(int type, int len, void* data, EventHandler* handler) {
+            m_evq.emplace(type, len, data, handler);
+        }
+        /// NOT thread safe: require loop thread, so do the two below
+        TimerHandle addTimer(const Timer& timer);
+        bool cancelTimer(TimerHandle h) { return m_timers.cancel(h); }
+        bool rescheduleTimer(TimerHandle h, const MicroTime& time) { 
+            return m_timers.reschedule(h, time); 
+        }
+        /// thread safe and lock free, the loop adds the timer in its next 
+        /// cycle. There is no handle, post an event to cancel it.
+        void postTimer(const Timer& timer);
+        /// sets the timer slack of the calling thread to 1 us, so that 
+        /// timers below 1 ms fire on time
         void run(int millis = 0);
         void setRunning(bool b) { m_running = b; }
         bool isRunning() { return m_running; }
+        /// NOT thread safe: call it before run(). A cycle handles at most
+        /// maxEvents events and stops starting new ones after maxMicros, 
+        /// 0 for no limit. The rest of the batch is handled in the next 
+        /// cycles, after the due timers.
+        void setDispatchLimits(size_t maxEvents, int maxMicros) {
+            m_maxEvents = maxEvents;
+            m_maxMicros = maxMicros;
+        }
+        /// cycles that left events for the next cycle
+        uint64_t cappedCycles() const { return m_cappedCycles; }
+        const TimerQueue::Stats& timerStats() const { 
+            return m_timers.stats(); 
+        }
+        /// NOT thread safe: call it before run(). While the loop spins, 
+        /// producers find no waiter on the monitor and skip the notify. 
+        /// SPIN_YIELD_PARK spins `spins` times and yields `yields` times.
+        void setWaitStrategy(WaitStrategy strategy, int spins = 10000, 
+                             int yields = 100) {
+            m_strategy = strategy;
+            m_spins = spins;
+            m_yields = yields;
+        }
+        /// the loop also dispatches events pushed to ring by one producer
+        /// thread. It is NOT thread safe: call it before run().
+        void addSource(EventRing& ring) { m_sources.push_back(&ring); }
+        /// the producer of a source calls it after a push, it wakes up the
+        /// loop if the loop is parked
+        void wakeup() {
+            // the push has to be visible before m_parked is read; getWork()
+            // sets m_parked with a locked exchange before it checks rings
+            seqFence();
+            if (m_parked != 0) {
+                LockGuard<Monitor> guard(m_monitor);
+                m_monitor.notify();
+            }
+        }
+        /// e.g. to bound a FastQueue with setCapacity()
+        Queue& queue() { return m_evq; }
         virtual void begin() {}
         virtual void end() {}        
     private:
         Monitor m_monitor;
-        bool m_running;
+        volatile bool m_running; // may be cleared by other threads
         TimerQueue m_timers;
-        EventQueue m_evq;
-        EventNode* getWork(const MicroTime& now, bool& waited);
+        Queue m_evq;
+        std::vector<EventRing*> m_sources;
+        volatile int m_parked; // waiting in getWork() with sources
+        WaitStrategy m_strategy;
+        int m_spins;
+        int m_yields;
+        size_t m_maxEvents;
+        int m_maxMicros;
+        uint64_t m_cappedCycles;
+        Node* m_pending; // rest of the batch left by the last cycle
+        Node* getWork(const MicroTime& now, bool& waited);
+        /// handle events from en on within the limits, return the rest
+        Node* dispatchEvents(Node* en);
+        /// spin until there is work or the budget is spent, false if the
+        /// loop is stopped meanwhile
+        bool spinForWork(MicroTime& now);
+        void dispatchSources();
     };
+    typedef BasicEventLoop<EventQueue> EventLoop;
+    typedef BasicEventLoop<MpscEventQueue> MpscEventLoop;
+
+    /**
+     * BasicEventLoopGroup runs N loops, each on its own thread pinned to a
+     * cpu. pushByKey() sends the events of one key to the same loop, so 
+     * they are handled in push order on one core. It is instantiated for
+     * EventLoop and MpscEventLoop in EventLoop.cpp.
+     */
+    template <typename Loop>
+    class BasicEventLoopGroup {
+    public:
+        /// loop i runs on cpus[i % cpus.size()], not pinned if cpus is 
+        /// empty or the cpu is -1. maxTimers is per loop.
+        BasicEventLoopGroup(size_t nLoops, 
+                            const std::vector<int>& cpus = std::vector<int>(),
+                            size_t maxTimers = TimerQueue::DEFAULT_MAX_TIMERS);
+        /// stops the loops if they are running
+        ~BasicEventLoopGroup();
+        /// thread safe. start() and stop() abort if called from a loop 
+        /// thread of this group.
+        void start();
+        /// thread safe, each loop stops in its next cycle. Events queued 
+        /// behind that cycle are not handled. Joins the loop threads. A
+        /// loop that already returned from run() is only joined.
+        void stop();
+        size_t size() const { return m_loops.size(); }
+        Loop& loop(size_t i) { return *m_loops[i]; }
+        void push(size_t i, const Event& event) { m_loops[i]->push(event); }
+        /// index of the loop of key
+        size_t route(uint64_t key) const {
+            // Fibonacci hashing spreads sequential keys over the loops
+            key *= ((uint64_t)0x9e3779b9 << 32) | 0x7f4a7c15;
+            return (size_t)((key >> 32) * m_loops.size() >> 32);
+        }
+        void pushByKey(uint64_t key, const Event& event) { 
+            m_loops[route(key)]->push(event); 
+        }
+    private:
+        class LoopThread : public Thread {
+        public:
+            LoopThread(const BasicEventLoopGroup* group, Loop& loop, int cpu) 
+                : Thread(true), m_group(group), m_loop(loop), m_cpu(cpu) {}
+            void run();
+        private:
+            const BasicEventLoopGroup* m_group;
+            Loop& m_loop;
+            int m_cpu;
+        };
+        /// aux of the stop timers. A loop that exits on its own leaves its 
+        /// stop timer posted, it is ignored once requested is reset.
+        struct StopRequest {
+            Loop* loop;
+            volatile bool requested;
+        };
+        static bool onStop(const Timer& timer);
+        BasicEventLoopGroup(const BasicEventLoopGroup&);
+        BasicEventLoopGroup& operator=(const BasicEventLoopGroup&);
+        std::vector<Loop*> m_loops;
+        std::vector<StopRequest> m_stops; // one per loop
+        std::vector<int> m_cpus;
+        std::vector<LoopThread*> m_threads; // empty when stopped
+        Mutex m_mutex; // guards start() and stop()
+    };
+    typedef BasicEventLoopGroup<EventLoop> EventLoopGroup;
+    typedef BasicEventLoopGroup<MpscEventLoop> MpscEventLoopGroup;
 
     // string utilities: it is provided for convenience, not performance
     char* trimLeft(char* str, const char* delim = " \f\n\r\t\v");
@@ -370,15 +1731,18 @@ namespace ate {
     /** 
      * tokenize() stores tokens in the vector. No empty token("") is returned.
      * Warning: tokenize() modifies the input string.
+     * The vector may use any allocator, e.g. BinAllocator.
      */
-    void tokenize(std::vector<char*>& tokens, char* str,
+    template <typename Alloc>
+    void tokenize(std::vector<char*, Alloc>& tokens, char* str,
                   const char* delim = " \f\n\r\t\v");
     /**
      * split() stores tokens in the vector. Empty token("") will be returned 
      * if there are consecutive delimiters or the string starts with delimiter.
      * Warning: tokenize() modifies the input string.
      */
-    void split(std::vector<char*>& tokens, char* str, 
+    template <typename Alloc>
+    void split(std::vector<char*, Alloc>& tokens, char* str, 
                const char* delim = " \f\n\r\t\v");
     
     // socket wrappers
@@ -475,15 +1839,16 @@ namespace ate {
     };
     
 } // namespace ate
-#include <ate/arch/Assembly.hpp>
 
 //////////////////////////////////////////////////////////////////////////////
 // template implementations
 //////////////////////////////////////////////////////////////////////////////
 namespace ate {
     template<typename T>
-    Pool<T>::Pool(const char* name, size_t initBlocks, size_t maxIncrement) 
-        : m_name(name), m_head(NULL), m_maxIncr(maxIncrement), m_size(0)
+    Pool<T>::Pool(const char* name, size_t initBlocks, size_t maxIncrement,
+                  const RegionPolicy& policy) 
+        : m_name(name), m_region(policy), m_head(NULL), 
+          m_maxIncr(maxIncrement), m_size(0), m_stats(name)
     {
         if (initBlocks == 0)
             initBlocks = 128;
@@ -498,10 +1863,11 @@ namespace ate {
         if (m_head == NULL) {
             size_t increment = m_size < m_maxIncr ? 
                 m_size : m_maxIncr;
-            grow(increment);
+            grow(increment != 0 ? increment : m_maxIncr); // 0 after trim()
         }
         T* ptr = reinterpret_cast<T*>(m_head->mem);
         m_head = m_head->next;        
+        m_stats.use(1);
         return ptr;
     }
    
@@ -510,6 +1876,9 @@ namespace ate {
     {
         Block* first;
         Block* cur;
+        // use the whole chunk if the region rounds it up
+        nBlocks = m_region.usable(sizeof(Block) * nBlocks) / sizeof(Block);
+        size_t bytes = m_region.bytes();
         first = cur = static_cast<Block*> 
             (m_region.malloc(sizeof(Block) * nBlocks));
         for (size_t i = 0; i < nBlocks - 1; ++i) {
@@ -519,7 +1888,11 @@ namespace ate {
         cur->next = m_head; // the list ends with NULL
         m_head = first;
         m_size += nBlocks;
-        std::cout << m_name << " capacity: " << m_size << std::endl;
+        Chunk chunk;
+        chunk.first = first;
+        chunk.nBlocks = nBlocks;
+        m_chunks.push_back(chunk);
+        m_stats.grown(nBlocks, m_region.bytes() - bytes);
     }
     
     template<typename T> inline
@@ -528,24 +1901,793 @@ namespace ate {
         Block* block = reinterpret_cast<Block*>(ptr);
         block->next = m_head;
         m_head = block;
+        m_stats.unuse(1);
+    }
+
+    template<typename T>
+    void Pool<T>::allocBulk(size_t n, T** out)
+    {
+        size_t i = 0;
+        while (i < n) {
+            if (m_head == NULL) {
+                size_t increment = m_size < m_maxIncr ? m_size : m_maxIncr;
+                if (increment < n - i)
+                    increment = n - i;
+                grow(increment);
+            }
+            Block* block = m_head;
+            for (; i < n && block != NULL; ++i) {
+                out[i] = reinterpret_cast<T*>(block->mem);
+                block = block->next;
+            }
+            m_head = block; // cut the taken segment off at once
+        }
+        m_stats.use(n);
+    }
+
+    template<typename T>
+    void Pool<T>::deallocBulk(size_t n, T* const* ptrs)
+    {
+        if (n == 0)
+            return;
+        Block* first = reinterpret_cast<Block*>(ptrs[0]);
+        Block* last = first;
+        for (size_t i = 1; i < n; ++i) {
+            Block* block = reinterpret_cast<Block*>(ptrs[i]);
+            last->next = block;
+            last = block;
+        }
+        last->next = m_head; 
+        m_head = first;
+        m_stats.unuse(n);
+    }
+
+    // m_chunks has to be sorted
+    template<typename T> 
+    typename Pool<T>::Chunk* Pool<T>::findChunk(Block* block)
+    {
+        Chunk key;
+        key.first = block;
+        typename std::vector<Chunk>::iterator it = 
+            std::upper_bound(m_chunks.begin(), m_chunks.end(), key);
+        return &*(--it); // the last chunk starting at or before block
+    }
+
+    template<typename T>
+    size_t Pool<T>::trim(size_t keepBlocks)
+    {
+        std::sort(m_chunks.begin(), m_chunks.end());
+        for (size_t i = 0; i < m_chunks.size(); ++i) {
+            m_chunks[i].nFree = 0;
+            m_chunks[i].released = false;
+        }
+        size_t nFree = 0;
+        for (Block* b = m_head; b != NULL; b = b->next, ++nFree) 
+            ++findChunk(b)->nFree;
+        size_t released = 0;
+        for (size_t i = 0; i < m_chunks.size(); ++i) {
+            Chunk& chunk = m_chunks[i];
+            if (chunk.nFree == chunk.nBlocks && 
+                nFree - chunk.nBlocks >= keepBlocks) {
+                nFree -= chunk.nBlocks;
+                released += chunk.nBlocks;
+                chunk.released = true;
+            } 
+        }
+        if (released == 0)
+            return 0;
+        // unlink the blocks of released chunks from the free list
+        Block** link = &m_head;
+        for (Block* b = m_head; b != NULL; b = b->next) {
+            if (!findChunk(b)->released) {
+                *link = b;
+                link = &b->next;
+            }
+        }
+        *link = NULL;
+        size_t bytes = m_region.bytes();
+        size_t n = 0;
+        for (size_t i = 0; i < m_chunks.size(); ++i) {
+            if (m_chunks[i].released) 
+                m_region.free(m_chunks[i].first);
+            else 
+                m_chunks[n++] = m_chunks[i];
+        }
+        m_chunks.resize(n);
+        m_size -= released;
+        m_stats.shrunk(released, bytes - m_region.bytes());
+        return released;
     }
     
+    inline uint64_t Clock::read(bool wall)
+    {
+        for (;;) {
+            int seq = s_base.seq;
+            acquireFence();
+            uint64_t ticks = getClockTicks() - s_base.ticks;
+            uint64_t base = wall ? s_base.wall : s_base.mono;
+            uint32_t mult = s_base.mult;
+            uint32_t shift = s_base.shift;
+            uint64_t floor = wall ? 0 : s_base.floor;
+            bool resync = ticks >= s_base.resyncTicks;
+            acquireFence();
+            if (seq != s_base.seq || (seq & 1) != 0) {
+                cpuPause();
+                continue;
+            }
+            if (resync)
+                return readSlow(wall);
+            uint64_t nanos = base + scale(ticks, mult, shift);
+            return nanos > floor ? nanos : floor;
+        }
+    }
+
+    template<typename T> inline
+    T SeqLock<T>::load() const
+    {
+        for (;;) {
+            int seq = m_seq;
+            acquireFence();
+            T value = m_value;
+            acquireFence();
+            if ((seq & 1) == 0 && seq == m_seq)
+                return value;
+            cpuPause();
+        }
+    }
+
+    template<typename T> inline
+    void SeqLock<T>::lock()
+    {
+        int pauseCount = 0;
+        for (;;) {
+            int seq = m_seq;
+            if ((seq & 1) == 0 && cmpAndSwap(&m_seq, seq, seq + 1) == seq)
+                return;
+            if (pauseCount++ < 32)
+                cpuPause();
+            else
+                Thread::yield();
+        }
+    }
+
+    inline MicroTime MicroTime::monotonic()
+    {
+        return NanoTime::monotonic().toMicroTime();
+    }
+
+    inline NanoTime NanoTime::now()
+    {
+        return NanoTime(Clock::read(true));
+    }
+
+    inline NanoTime NanoTime::monotonic()
+    {
+        return NanoTime(Clock::read(false));
+    }
+
+    inline NanoTime NanoTime::cached()
+    {
+        if (Clock::s_cached == 0)
+            return Clock::update();
+        return NanoTime(Clock::s_cached);
+    }
+
+    template<typename T>
+    SpscRing<T>::SpscRing(size_t capacity, const RegionPolicy& policy) 
+        : m_head(0), m_tailCache(0), m_tail(0), m_headCache(0), 
+          m_region(policy)
+    {
+        size_t size = 1;
+        while (size < capacity)
+            size <<= 1;
+        m_mask = size - 1;
+        m_slots = static_cast<T*>(m_region.malloc(sizeof(T) * size));
+    }
+
+    template<typename T>
+    SpscRing<T>::~SpscRing()
+    {
+        for (size_t i = m_head; i != m_tail; ++i)
+            m_slots[i & m_mask].~T();
+    }
+
+    template<typename T> template <typename InputIterator>
+    size_t SpscRing<T>::tryPushN(InputIterator first, InputIterator last)
+    {
+        size_t tail = m_tail;
+        size_t n = 0;
+        for (; first != last; ++first, ++n) {
+            if (tail + n - m_headCache > m_mask) { // looks full
+                m_headCache = m_head;
+                if (tail + n - m_headCache > m_mask)
+                    break;
+            }
+            new(&m_slots[(tail + n) & m_mask]) T(*first);
+        }
+        releaseFence(); // the elements before the index
+        m_tail = tail + n;
+        return n;
+    }
+
+    template<typename T> template <typename OutputIterator>
+    size_t SpscRing<T>::tryPopN(OutputIterator out, size_t n)
+    {
+        size_t head = m_head;
+        if (m_tailCache - head < n) { // may not have n elements
+            m_tailCache = m_tail;
+            acquireFence();
+            if (m_tailCache - head < n)
+                n = m_tailCache - head;
+        }
+        for (size_t i = 0; i < n; ++i, ++out) {
+            T& slot = m_slots[(head + i) & m_mask];
+            *out = slot;
+            slot.~T();
+        }
+        releaseFence(); // the slots are read before they are reused
+        m_head = head + n;
+        return n;
+    }
+
+    template<typename T>
+    MpscQueue<T>::~MpscQueue()
+    {
+        recycle(m_batch);
+        recycle(m_stub.next); // no producer is left
+    }
+
+    template<typename T>
+    void MpscQueue<T>::push(const T& elem) 
+    {
+        pushNode(new(allocNode()) T(elem)); // use copy constructor
+    }
+
+    template<typename T> template <typename InputIterator>
+    void MpscQueue<T>::pushN(InputIterator first, InputIterator last) 
+    {
+        if (first == last)
+            return;
+        // build the chain privately, then link it with one exchange
+        Node* head = m_pool.alloc();
+        new(&head->obj) T(*first);
+        Node* tail = head;
+        for (++first; first != last; ++first) {
+            Node* node = m_pool.alloc();
+            new(&node->obj) T(*first);
+            tail->next = node;
+            tail = node;
+        }
+        if (link(head, tail) == &m_stub && m_waiting != 0) {
+            LockGuard<Monitor> guard(m_monitor);
+            m_monitor.notify();
+        }
+    }
+
+    template<typename T> inline
+    void MpscQueue<T>::pushNode(T* obj) 
+    {
+        Node* node = reinterpret_cast<Node*>(
+            reinterpret_cast<char*>(obj) - offsetof(Node, obj));
+        // the stub was the tail: the queue was empty or the consumer 
+        // just took a batch
+        if (link(node) == &m_stub && m_waiting != 0) {
+            LockGuard<Monitor> guard(m_monitor);
+            m_monitor.notify();
+        }
+    }
+
+    template<typename T>
+    void MpscQueue<T>::recycle(Node* batch) 
+    {
+        Node* nodes[64];
+        size_t n = 0;
+        while (batch != NULL) {
+            batch->obj.~T();
+            nodes[n++] = batch;
+            batch = batch->next;
+            if (n == sizeof(nodes) / sizeof(nodes[0]) || batch == NULL) {
+                m_pool.deallocBulk(n, nodes);
+                n = 0;
+            }
+        }
+    }
+
+    template<typename T> inline typename MpscQueue<T>::Node* 
+    MpscQueue<T>::getWork(const MicroTime& abstime)
+    {
+        LockGuard<Monitor> guard(m_monitor);
+        return getWorkWithLock(abstime);
+    }
+
+    template<typename T> typename MpscQueue<T>::Node* 
+    MpscQueue<T>::takeBatch()
+    {
+        Node* first = m_stub.next;
+        if (first == NULL)
+            return NULL;
+        // the stub is not the tail, no producer writes m_stub.next now
+        m_stub.next = NULL;
+        link(&m_stub);
+        Node* last = first;
+        unsigned int pauseCount = 0;
+        while (last->next != &m_stub) {
+            if (last->next != NULL) {
+                last = last->next;
+            } else if (pauseCount++ < 32) { // a producer is linking
+                cpuPause();
+            } else {
+                Thread::yield();
+            }
+        }
+        last->next = NULL;
+        return first;
+    }
+
+    template<typename T> typename MpscQueue<T>::Node* 
+    MpscQueue<T>::getWorkWithLock(const MicroTime& abstime)
+    {
+        recycle(m_batch); // free the last batch first
+        m_batch = NULL;
+        for (;;) {
+            if ((m_batch = takeBatch()) != NULL)
+                return m_batch;
+            if (m_tail != &m_stub) { // a producer is linking
+                cpuPause();
+                continue;
+            }
+            // a push after this sees m_waiting and waits for the monitor
+            exchange(&m_waiting, 1);
+            if (m_tail == &m_stub)
+                m_monitor.timedWait(abstime);
+            m_waiting = 0;
+            if (m_tail == &m_stub) // timed out or woken up without item
+                return NULL;
+        }
+    }
+
+    template<typename T, int IndexBits>
+    HandlePool<T, IndexBits>::HandlePool(const char* name, size_t maxSlots, 
+                                         size_t increment)
+        : m_name(name), 
+          m_maxSlots(maxSlots < MAX_SLOTS ? maxSlots : (size_t)MAX_SLOTS),
+          m_increment(increment != 0 ? increment : 1024), 
+          m_slots(sizeof(Slot) * m_maxSlots), 
+          m_gens(sizeof(uint32_t) * m_maxSlots),
+          m_capacity(0), m_free(NO_SLOT), m_freeTail(NO_SLOT), m_stats(name)
+    {
+    }
+
+    template<typename T, int IndexBits>
+    typename HandlePool<T, IndexBits>::Handle HandlePool<T, IndexBits>::alloc()
+    {
+        if (m_free == NO_SLOT)
+            grow();
+        uint32_t index = m_free;
+        m_free = slots()[index].next;
+        if (m_free == NO_SLOT)
+            m_freeTail = NO_SLOT;
+        uint32_t gen = (gens()[index] + 1) & GEN_MASK; // odd: live
+        gens()[index] = gen;
+        m_stats.use(1);
+        return (gen << INDEX_BITS) | index;
+    }
+
+    template<typename T, int IndexBits>
+    void HandlePool<T, IndexBits>::dealloc(Handle h)
+    {
+        ATE_ASSERT(get(h) != NULL);
+        uint32_t index = h & INDEX_MASK;
+        // even: free, handles to it are stale now
+        gens()[index] = (gens()[index] + 1) & GEN_MASK;
+        release(index);
+        m_stats.unuse(1);
+    }
+
+    template<typename T, int IndexBits> inline
+    T* HandlePool<T, IndexBits>::get(Handle h) const
+    {
+        uint32_t index = h & INDEX_MASK;
+        if (index >= m_capacity || gens()[index] != (h >> INDEX_BITS))
+            return NULL;
+        return slot(index);
+    }
+
+    template<typename T, int IndexBits>
+    typename HandlePool<T, IndexBits>::Handle 
+    HandlePool<T, IndexBits>::handleOf(const T* ptr) const
+    {
+        uint32_t index = reinterpret_cast<const Slot*>(ptr) - slots();
+        return (gens()[index] << INDEX_BITS) | index;
+    }
+
+    template<typename T, int IndexBits>
+    void HandlePool<T, IndexBits>::release(uint32_t index)
+    {
+        slots()[index].next = NO_SLOT;
+        if (m_freeTail == NO_SLOT)
+            m_free = index;
+        else
+            slots()[m_freeTail].next = index;
+        m_freeTail = index;
+    }
+
+    template<typename T, int IndexBits>
+    void HandlePool<T, IndexBits>::grow()
+    {
+        size_t capacity = m_capacity + m_increment;
+        if (capacity > m_maxSlots)
+            capacity = m_maxSlots;
+        if (capacity == m_capacity)
+            ATE_ABORT(m_name << " is full: " << m_maxSlots);
+        size_t bytes = m_slots.committed() + m_gens.committed();
+        m_slots.commit(sizeof(Slot) * capacity);
+        m_gens.commit(sizeof(uint32_t) * capacity);
+        // slots are queued in ascending order, so they are handed out densely
+        for (size_t i = m_capacity; i < capacity; ++i)
+            release(i);
+        m_stats.grown(capacity - m_capacity, 
+                      m_slots.committed() + m_gens.committed() - bytes);
+        m_capacity = capacity;
+    }
+
+    template<typename T>
+    CachedPool<T>::CachedPool(const char* name, size_t batchBlocks)
+        : m_name(name), m_batch(batchBlocks), m_caches(NULL), m_stats(name)
+    {
+        if (m_batch == 0)
+            m_batch = 256;
+        ATE_ASSERT(pthread_key_create(&m_key, &CachedPool<T>::orphan) == 0);
+    }
+
+    template<typename T>
+    CachedPool<T>::~CachedPool()
+    {
+        // no more thread exit callbacks, m_region releases the memory
+        pthread_key_delete(m_key); 
+    }
+
+    template<typename T> inline
+    T* CachedPool<T>::alloc()
+    {
+        Cache* cache = static_cast<Cache*>(pthread_getspecific(m_key));
+        if (cache == NULL) 
+            cache = getCache();
+        Block* block = cache->head;
+        if (block == NULL) 
+            block = refill(cache);
+        cache->head = block->u.next;
+        return reinterpret_cast<T*>(block->u.mem);
+    }
+
+    template<typename T> inline
+    void CachedPool<T>::dealloc(T* ptr)
+    {
+        Block* block = reinterpret_cast<Block*>
+            (reinterpret_cast<char*>(ptr) - offsetof(Block, u));
+        Cache* cache = block->owner;
+        if (cache == pthread_getspecific(m_key)) { // freed by the owner
+            block->u.next = cache->head;
+            cache->head = block;
+            return;
+        }
+        void* volatile* remote = 
+            reinterpret_cast<void* volatile*>(&cache->remote);
+        void* head;
+        do { // push to owner's remote list; pops always take the whole list
+            head = cache->remote;
+            block->u.next = static_cast<Block*>(head);
+        } while (cmpAndSwapPtr(remote, head, block) != head);
+    }
+
+    template<typename T>
+    typename CachedPool<T>::Cache* CachedPool<T>::getCache()
+    {
+        Cache* cache;
+        {
+            LockGuard<SpinLock> guard(m_lock);
+            for (cache = m_caches; cache != NULL; cache = cache->next) {
+                if (cache->orphaned) 
+                    break;
+            }
+            if (cache == NULL) { 
+                cache = static_cast<Cache*>(m_region.malloc(sizeof(Cache)));
+                cache->head = NULL;
+                cache->size = 0;
+                cache->pool = this;
+                cache->remote = NULL;
+                cache->next = m_caches;
+                m_caches = cache;
+            }
+            cache->orphaned = false;
+        }
+        ATE_ASSERT(pthread_setspecific(m_key, cache) == 0);
+        return cache;
+    }
+
+    template<typename T>
+    typename CachedPool<T>::Block* CachedPool<T>::refill(Cache* cache)
+    {
+        if (cache->remote != NULL) { // reuse blocks freed by other threads
+            void* head = fetchAndStorePtr
+                (reinterpret_cast<void* volatile*>(&cache->remote), NULL);
+            return static_cast<Block*>(head);
+        }
+        Block* first;
+        {
+            LockGuard<SpinLock> guard(m_lock);
+            size_t bytes = m_region.bytes();
+            first = static_cast<Block*>
+                (m_region.malloc(sizeof(Block) * m_batch));
+            m_stats.grown(m_batch, m_region.bytes() - bytes);
+        }
+        Block* cur = first;
+        for (size_t i = 0; i < m_batch - 1; ++i) {
+            cur->owner = cache;
+            cur->u.next = cur + 1;
+            ++cur;
+        }
+        cur->owner = cache;
+        cur->u.next = NULL;
+        cache->size += m_batch;
+        return first;
+    }
+
+    template<typename T>
+    void CachedPool<T>::orphan(void* ptr)
+    {
+        Cache* cache = static_cast<Cache*>(ptr);
+        LockGuard<SpinLock> guard(cache->pool->m_lock);
+        cache->orphaned = true;
+    }
+
+    template<typename T>
+    ConcurrentPool<T>::ConcurrentPool(const char* name, size_t initBlocks, 
+                                      size_t maxIncrement,
+                                      const RegionPolicy& policy) 
+        : m_name(name), m_region(policy), m_maxIncr(maxIncrement), m_size(0),
+          m_stats(name)
+    {
+        m_head.ptr = NULL;
+        m_head.tag = 0;
+        if (initBlocks == 0)
+            initBlocks = 128;
+        if (m_maxIncr == 0)
+            m_maxIncr = 1024;
+        grow(initBlocks);
+    }
+
+    template<typename T> inline
+    T* ConcurrentPool<T>::alloc()
+    {
+        TaggedPtr head;
+        TaggedPtr next;
+        head.ptr = m_head.ptr;
+        head.tag = m_head.tag; // a torn read only fails the swap below
+        while (true) {
+            Block* block = static_cast<Block*>(head.ptr);
+            if (block == NULL) { 
+                if (m_growLock.tryLock()) {
+                    if (m_head.ptr == NULL) // nobody grew it meanwhile
+                        grow(m_size < m_maxIncr ? m_size : m_maxIncr);
+                    m_growLock.unlock();
+                } else { // another thread is growing
+                    cpuPause();
+                }
+                head.ptr = m_head.ptr;
+                head.tag = m_head.tag;
+                continue;
+            }
+            // block may be taken by another thread already, then next is
+            // garbage but the tag has changed and the swap fails
+            next.ptr = block->next;
+            next.tag = head.tag + 1;
+            if (cmpAndSwap2(&m_head, head, next))
+                return reinterpret_cast<T*>(block->mem);
+        }
+    }
+
+    template<typename T> inline
+    void ConcurrentPool<T>::dealloc(T* ptr)
+    {
+        Block* block = reinterpret_cast<Block*>(ptr);
+        push(block, block);
+    }
+
+    template<typename T>
+    void ConcurrentPool<T>::deallocBulk(size_t n, T* const* ptrs)
+    {
+        if (n == 0)
+            return;
+        Block* first = reinterpret_cast<Block*>(ptrs[0]);
+        Block* last = first;
+        for (size_t i = 1; i < n; ++i) {
+            last->next = reinterpret_cast<Block*>(ptrs[i]);
+            last = last->next;
+        }
+        push(first, last);
+    }
+
+    template<typename T>
+    void ConcurrentPool<T>::push(Block* first, Block* last)
+    {
+        TaggedPtr head;
+        TaggedPtr next;
+        head.ptr = m_head.ptr;
+        head.tag = m_head.tag;
+        next.ptr = first;
+        do {
+            last->next = static_cast<Block*>(head.ptr);
+            next.tag = head.tag + 1;
+        } while (!cmpAndSwap2(&m_head, head, next));
+    }
+
+    template<typename T>
+    void ConcurrentPool<T>::grow(size_t nBlocks) 
+    {
+        Block* first;
+        Block* cur;
+        nBlocks = m_region.usable(sizeof(Block) * nBlocks) / sizeof(Block);
+        size_t bytes = m_region.bytes();
+        first = cur = static_cast<Block*> 
+            (m_region.malloc(sizeof(Block) * nBlocks));
+        for (size_t i = 0; i < nBlocks - 1; ++i) {
+            cur->next = cur + 1;
+            ++cur;
+        }
+        push(first, cur);
+        m_size += nBlocks;
+        m_stats.grown(nBlocks, m_region.bytes() - bytes);
+    }
+
     template<typename T>
-    void FastQueue<T>::push(const T& elem) 
+    FastQueue<T>::~FastQueue() 
     {
+        for (Node* node = m_rhead; node != NULL; node = node->next)
+            node->obj.~T();
+        if (m_wtail != &m_whead) {
+            for (Node* node = m_whead.next; ; node = node->next) {
+                node->obj.~T();
+                if (node == m_wtail)
+                    break;
+            }
+        }
+    }
+
+    template<typename T>
+    void FastQueue<T>::setCapacity(size_t capacity, Overflow overflow) 
+    {
+        LockGuard<Monitor> guard(m_monitor);
+        m_capacity = capacity;
+        m_overflow = overflow;
+        if (m_blocking != 0) // the old capacity may have been smaller
+            m_monitor.notifyAll();
+    }
+
+    template<typename T>
+    void FastQueue<T>::setHighWater(size_t mark, HighWaterCallback callback,
+                                    void* aux) 
+    {
+        LockGuard<Monitor> guard(m_monitor);
+        m_highMark = callback != NULL ? mark : 0;
+        m_highCallback = callback;
+        m_highAux = aux;
+        m_aboveHigh = false;
+    }
+
+    template<typename T>
+    bool FastQueue<T>::push(const T& elem) 
+    {
+        void* p = pushSlot(m_overflow);
+        if (p == NULL)
+            return false;
+        new(p) T(elem); // use copy constructor to copy value
+        pushDone();
+        return true;
+    }
+
+    template<typename T>
+    bool FastQueue<T>::tryPush(const T& elem) 
+    {
+        void* p = pushSlot(m_overflow == BLOCK ? FAIL : m_overflow);
+        if (p == NULL)
+            return false;
+        new(p) T(elem); 
+        pushDone();
+        return true;
+    }
+
+    template<typename T> template <typename InputIterator>
+    void FastQueue<T>::pushN(InputIterator first, InputIterator last) 
+    {
+        if (first == last)
+            return;
         LockGuard<Monitor> guard(m_monitor);
         bool empty = (m_wtail == &m_whead); // empty queue
-        Node* newNode;
-        if (m_wtail->next == NULL) { // no more free nodes
-            size_t increment = m_size < m_maxIncr ? m_size : m_maxIncr;
-            grow(increment);
-        } 
-        // now we have some free nodes
-        newNode = m_wtail->next;
-        new(&newNode->obj) T(elem); // use copy constructor to copy value
+        size_t n = 0;
+        for (; first != last; ++first) {
+            if (m_capacity != 0 && m_wcount + n >= m_capacity) {
+                // settle the elements so far before the policy applies
+                m_wcount += n;
+                m_stats.use(n);
+                n = 0;
+                if (empty && m_wtail != &m_whead) 
+                    m_monitor.notify();
+                if (!makeRoom(m_overflow))
+                    continue;
+                empty = (m_wtail == &m_whead);
+            }
+            // the free nodes behind the tail are already linked, so the
+            // consumer sees the whole batch once the lock is released
+            new(&nextFree()->obj) T(*first);
+            m_wtail = m_wtail->next;
+            ++n;
+        }
+        m_wcount += n;
+        m_stats.use(n);
+        if (empty && m_wtail != &m_whead) 
+            m_monitor.notify();        
+        checkHighWater();
+    }
+
+    template<typename T> inline 
+    void* FastQueue<T>::pushSlot(Overflow overflow) 
+    {
+        m_monitor.lock();
+        if (m_capacity != 0 && m_wcount >= m_capacity && 
+            !makeRoom(overflow)) {
+            m_monitor.unlock();
+            return NULL;
+        }
+        return &nextFree()->obj;
+    }
+
+    template<typename T> inline 
+    void FastQueue<T>::pushDone() 
+    {
+        bool empty = (m_wtail == &m_whead); // empty queue
         m_wtail = m_wtail->next;
+        ++m_wcount;
+        m_stats.use(1);
         if (empty) 
             m_monitor.notify();        
+        checkHighWater();
+        m_monitor.unlock();
+    }
+
+    template<typename T>
+    bool FastQueue<T>::makeRoom(Overflow overflow) 
+    {
+        switch (overflow) {
+        case BLOCK:
+            ++m_overflowStats.blocked;
+            ++m_blocking;
+            // the queue is not empty, so the consumer is not waiting
+            while (m_capacity != 0 && m_wcount >= m_capacity)
+                m_monitor.wait();
+            --m_blocking;
+            return true;
+        case DROP_OLDEST: {
+            // move the head node behind the tail to the free nodes
+            Node* node = m_whead.next;
+            node->obj.~T();
+            m_whead.next = node->next;
+            if (m_wtail == node)
+                m_wtail = &m_whead;
+            node->next = m_wtail->next;
+            m_wtail->next = node;
+            --m_wcount;
+            m_stats.unuse(1);
+            ++m_overflowStats.dropped;
+            return true;
+        }
+        case DROP_NEWEST:
+            ++m_overflowStats.dropped;
+            return false;
+        default: // FAIL
+            ++m_overflowStats.rejected;
+            return false;
+        }
     }
     
     template<typename T> inline typename FastQueue<T>::Node* 
@@ -560,6 +2702,8 @@ namespace ate {
     {
         Node* first;
         Node* cur;
+        nNodes = m_region.usable(sizeof(Node) * nNodes) / sizeof(Node);
+        size_t bytes = m_region.bytes();
         first = cur = static_cast<Node*>
             (m_region.malloc(sizeof(Node) * nNodes));
         for (size_t i = 0; i < nNodes - 1; ++i) {
@@ -569,32 +2713,91 @@ namespace ate {
         cur->next = NULL; // the list ends with NULL
         m_wtail->next = first;
         m_size += nNodes;
-        std::cout << m_name << " capacity: " << m_size << std::endl;
+        m_stats.grown(nNodes, m_region.bytes() - bytes);
     }
     
     template<typename T> typename FastQueue<T>::Node* 
     FastQueue<T>::getWorkWithLock(const MicroTime& abstime)
     {
         if (m_rhead != NULL) { // free read queue memory first 
+            for (Node* node = m_rhead; node != NULL; node = node->next)
+                node->obj.~T();
             Node* tmp = m_wtail->next;
             m_wtail->next = m_rhead;
             m_rtail->next = tmp;
             m_rhead = m_rtail = NULL;
+            m_stats.unuse(m_rcount);
+            m_rcount = 0;
         }
         m_waitTime = abstime;
-        while (m_wtail == &m_whead) { // no item in the queue yet
-            std::cout << "event queue is empty, waiting..." << std::endl;
-            if (m_monitor.timedWait(m_waitTime) == ETIMEDOUT) 
+        if (m_wtail == &m_whead) { // no item in the queue yet
+            m_monitor.timedWait(m_waitTime);
+            if (m_wtail == &m_whead) // timed out or woken up without item
                 return NULL;
         }
         m_rhead = m_whead.next;
         m_rtail = m_wtail;
         m_whead.next = m_wtail->next;
         m_rtail->next = NULL;
+        m_rcount = m_wcount;
+        m_wcount = 0;
         // reset write queue tail
         m_wtail = &m_whead;
+        if (m_blocking != 0)
+            m_monitor.notifyAll();
+        if (m_aboveHigh) {
+            m_aboveHigh = false;
+            m_highCallback(false, m_highAux);
+        }
         return m_rhead;
     } 
+
+    template <typename Alloc>
+    void tokenize(std::vector<char*, Alloc>& tokens, char* str, 
+                  const char* delim)
+    {
+        char* saveptr;
+        for (char* token = strtok_r(str, delim, &saveptr); token != NULL;
+             token = strtok_r(NULL, delim, &saveptr)) 
+            tokens.push_back(token);
+    }
+
+    template <typename Alloc>
+    void split(std::vector<char*, Alloc>& tokens, char* str, 
+               const char* delim)
+    {
+        while (str != NULL) { // same as strsep()
+            char* token = str;
+            str = strpbrk(str, delim);
+            if (str != NULL)
+                *str++ = '\0';
+            tokens.push_back(token);
+        }
+    }
+
+    template <typename T, typename U> inline 
+    bool operator==(const BinAllocator<T>& a, const BinAllocator<U>& b)
+    {
+        return a.bin() == b.bin();
+    }
+
+    template <typename T, typename U> inline 
+    bool operator!=(const BinAllocator<T>& a, const BinAllocator<U>& b)
+    {
+        return a.bin() != b.bin();
+    }
+
+    template <typename T, typename U> inline 
+    bool operator==(const PoolAllocator<T>&, const PoolAllocator<U>&)
+    {
+        return true;
+    }
+
+    template <typename T, typename U> inline 
+    bool operator!=(const PoolAllocator<T>&, const PoolAllocator<U>&)
+    {
+        return false;
+    }
 } 
 
 // global implementations
@@ -628,6 +2831,36 @@ inline bool operator<=(const ate::MicroTime& t1, const ate::MicroTime& t2)
     return t1.microsec <= t2.microsec;
 }
 
+inline bool operator==(const ate::NanoTime& t1, const ate::NanoTime& t2)
+{
+    return t1.nanosec == t2.nanosec;
+}
+
+inline bool operator!=(const ate::NanoTime& t1, const ate::NanoTime& t2)
+{
+    return t1.nanosec != t2.nanosec;
+}
+
+inline bool operator<(const ate::NanoTime& t1, const ate::NanoTime& t2)
+{
+    return t1.nanosec < t2.nanosec;
+}
+
+inline bool operator>(const ate::NanoTime& t1, const ate::NanoTime& t2)
+{
+    return t1.nanosec > t2.nanosec;
+}
+
+inline bool operator>=(const ate::NanoTime& t1, const ate::NanoTime& t2)
+{
+    return t1.nanosec >= t2.nanosec;
+}
+
+inline bool operator<=(const ate::NanoTime& t1, const ate::NanoTime& t2)
+{
+    return t1.nanosec <= t2.nanosec;
+}
+
 inline std::ostream& operator<<(std::ostream& os, const ate::MicroTime& ts)
 {
     uint64_t v = ts.microsec;
@@ -640,4 +2873,16 @@ inline std::ostream& operator<<(std::ostream& os, const ate::MicroTime& ts)
     return os << buf;
 }
 
+inline std::ostream& operator<<(std::ostream& os, const ate::NanoTime& ts)
+{
+    uint64_t v = ts.nanosec;
+    int nanosec = v % 1000000000;  v /= 1000000000;
+    int sec = v % 60; v /= 60;
+    int min = v % 60; v /= 60;
+    int hour = v % 24; 
+    char buf[20];
+    snprintf(buf, sizeof(buf), "%02u%02u%02u.%09u", hour, min, sec, nanosec);
+    return os << buf;
+}
+
 #endif // ATE_HPP
@@ -1,5 +1,27 @@
 #include <ate/ate.hpp>
 
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#ifndef MPOL_BIND
+#define MPOL_BIND 2
+#endif
+
+namespace {
+    const size_t pageSize = 4096;
+    const size_t hugePageSize = 2 * 1024 * 1024;
+
+    ate::SpinLock registryLock;
+    ate::AllocCounters* registryHead = NULL; // protected by registryLock
+    ate::GrowHook growHook = NULL;
+
+    inline size_t roundUp(size_t n, size_t unit)
+    {
+        return (n + unit - 1) & ~(unit - 1);
+    }
+}
+
 namespace ate {
     /// linux page size is 4096 bytes.
     /// malloc() uses 8 bytes for x86 and 16 bytes for x86_64. 
@@ -9,54 +31,304 @@ namespace ate {
     const size_t Bin::s_size = 4 * 4096 - sizeof(ate::Region::Link) - 16;
 #endif
 
-    Region::Region() : m_head(NULL) {}
+    AllocCounters::AllocCounters(const char* name)
+    {
+        this->name = name;
+        inUse = peak = capacity = grows = reserved = wasted = 0;
+        AllocRegistry::add(this);
+    }
+
+    AllocCounters::~AllocCounters()
+    {
+        AllocRegistry::remove(this);
+    }
+
+    void AllocCounters::grown(size_t blocks, size_t bytes)
+    {
+        capacity += blocks;
+        reserved += bytes;
+        ++grows;
+        AllocRegistry::grown(*this);
+    }
+
+    void AllocRegistry::add(AllocCounters* counters)
+    {
+        LockGuard<SpinLock> guard(registryLock);
+        counters->m_prev = NULL;
+        counters->m_next = registryHead;
+        if (registryHead != NULL)
+            registryHead->m_prev = counters;
+        registryHead = counters;
+    }
+
+    void AllocRegistry::remove(AllocCounters* counters)
+    {
+        LockGuard<SpinLock> guard(registryLock);
+        if (counters->m_prev != NULL)
+            counters->m_prev->m_next = counters->m_next;
+        else 
+            registryHead = counters->m_next;
+        if (counters->m_next != NULL)
+            counters->m_next->m_prev = counters->m_prev;
+    }
+
+    void AllocRegistry::snapshot(std::vector<AllocStats>& stats)
+    {
+        LockGuard<SpinLock> guard(registryLock);
+        for (AllocCounters* c = registryHead; c != NULL; c = c->m_next)
+            stats.push_back(*c);
+    }
+
+    GrowHook AllocRegistry::setGrowHook(GrowHook hook)
+    {
+        GrowHook old = growHook;
+        growHook = hook;
+        return old;
+    }
+
+    void AllocRegistry::grown(const AllocStats& stats)
+    {
+        GrowHook hook = growHook;
+        if (hook != NULL)
+            hook(stats);
+    }
+
+    Region::Region(const RegionPolicy& policy) 
+        : m_head(NULL), m_policy(policy), m_bytes(0), m_chunks(0) {}
     
     Region::~Region()
     {
+        bool heap = (m_policy.backing == RegionPolicy::HEAP);
         for (Link* cur = m_head; cur != NULL; cur = m_head) {
-            m_head = m_head->next;
-            ::free(cur);
+            m_head = m_head->info.next;
+            if (heap) 
+                ::free(cur);
+            else 
+                munmap(cur, cur->info.size);
         }
     }
     
+    size_t Region::usable(size_t n) const
+    {
+        switch (m_policy.backing) {
+        case RegionPolicy::HEAP:
+            return n;
+        case RegionPolicy::MMAP:
+            return roundUp(sizeof(Link) + n, pageSize) - sizeof(Link);
+        default:
+            return roundUp(sizeof(Link) + n, hugePageSize) - sizeof(Link);
+        }
+    }
+
     void* Region::malloc(size_t n) 
     {        
-        Link* link = static_cast<Link*>(::malloc(sizeof(Link) + n));
-        if (link == NULL) {
-            std::cerr << "malloc() out of memory!!" << std::endl;
-            ::abort();
+        Link* link;
+        if (m_policy.backing == RegionPolicy::HEAP) {
+            link = static_cast<Link*>(::malloc(sizeof(Link) + n));
+            if (link == NULL) {
+                std::cerr << "malloc() out of memory!!" << std::endl;
+                ::abort();
+            }
+            link->info.size = sizeof(Link) + n;
+        } else {
+            size_t len = sizeof(Link) + usable(n);
+            link = static_cast<Link*>(map(len));
+            link->info.size = len;
         }
-        link->next = m_head;
+        link->info.next = m_head;
+        link->info.prev = NULL;
+        if (m_head != NULL)
+            m_head->info.prev = link;
         m_head = link;
+        m_bytes += link->info.size;
+        ++m_chunks;
         return (link + 1);
     }
 
-    Bin::Bin()
+    void Region::free(void* ptr)
     {
-        m_cur = static_cast<char*>(m_region.malloc(s_size));
-        m_end = m_cur + s_size;
+        Link* link = static_cast<Link*>(ptr) - 1;
+        if (link->info.prev != NULL)
+            link->info.prev->info.next = link->info.next;
+        else 
+            m_head = link->info.next;
+        if (link->info.next != NULL)
+            link->info.next->info.prev = link->info.prev;
+        m_bytes -= link->info.size;
+        --m_chunks;
+        if (m_policy.backing == RegionPolicy::HEAP) 
+            ::free(link);
+        else 
+            munmap(link, link->info.size);
+    }
+
+    // map len bytes, len is a multiple of the page size of the backing
+    void* Region::map(size_t len)
+    {
+        const int prot = PROT_READ | PROT_WRITE;
+        const int flags = MAP_PRIVATE | MAP_ANONYMOUS;
+        void* mem = MAP_FAILED;
+        if (m_policy.backing == RegionPolicy::HUGETLB) {
+            mem = mmap(NULL, len, prot, flags | MAP_HUGETLB, -1, 0);
+            if (mem == MAP_FAILED) { // no huge pages reserved
+                std::cerr << "mmap(MAP_HUGETLB) failed, "
+                          << "using transparent huge pages" << std::endl;
+                m_policy.backing = RegionPolicy::HUGE_PAGE;
+            }
+        }
+        if (m_policy.backing == RegionPolicy::HUGE_PAGE) {
+            // map one more huge page to cut a 2 MB aligned range out of it
+            char* raw = static_cast<char*>
+                (mmap(NULL, len + hugePageSize, prot, flags, -1, 0));
+            if (raw != MAP_FAILED) {
+                char* aligned = reinterpret_cast<char*>
+                    (roundUp(reinterpret_cast<size_t>(raw), hugePageSize));
+                if (aligned > raw)
+                    munmap(raw, aligned - raw);
+                munmap(aligned + len, raw + hugePageSize - aligned);
+                mem = aligned;
+                madvise(mem, len, MADV_HUGEPAGE); // best effort
+            }
+        } else if (m_policy.backing == RegionPolicy::MMAP) {
+            mem = mmap(NULL, len, prot, flags, -1, 0);
+        }
+        if (mem == MAP_FAILED)
+            ATE_ABORT("mmap() out of memory: " << len);
+        if (m_policy.numaNode >= 0) { // bind before the pages are touched
+            unsigned long nodeMask = 1UL << m_policy.numaNode;
+            if (syscall(SYS_mbind, mem, len, MPOL_BIND, &nodeMask,
+                        sizeof(nodeMask) * 8 + 1, 0) != 0) {
+                std::cerr << "mbind() to numa node " << m_policy.numaNode
+                          << " failed: " << strerror(errno) << std::endl;
+                m_policy.numaNode = -1; // don't try again
+            }
+        }
+        return mem;
+    }
+
+    VirtualRange::VirtualRange(size_t maxBytes)
+        : m_reserved(roundUp(maxBytes, pageSize)), m_committed(0)
+    {
+        void* mem = mmap(NULL, m_reserved, PROT_NONE, 
+                         MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+        if (mem == MAP_FAILED)
+            ATE_ABORT("mmap() can not reserve " << m_reserved << " bytes");
+        m_base = static_cast<char*>(mem);
+    }
+
+    VirtualRange::~VirtualRange()
+    {
+        munmap(m_base, m_reserved);
+    }
+
+    bool VirtualRange::commit(size_t n)
+    {
+        if (n <= m_committed)
+            return true;
+        if (n > m_reserved)
+            return false;
+        n = roundUp(n, pageSize);
+        if (mprotect(m_base + m_committed, n - m_committed, 
+                     PROT_READ | PROT_WRITE) != 0)
+            ATE_ABORT("mprotect() failed: " << n);
+        m_committed = n;
+        return true;
+    }
+
+    Bin::Bin(const RegionPolicy& policy, bool zero, const char* name) 
+        : m_region(policy), m_size(m_region.usable(s_size)), m_zero(zero),
+          m_chunk(NULL), m_spare(NULL), m_big(NULL), m_stats(name)
+    {
+        nextChunk();
+        m_first = m_chunk;
     }
 
     void* Bin::alloc(size_t n, bool zero)
     {
         n = align(n);
         char* ptr;
-        if (n > s_size) { // big memory request
-            ptr = static_cast<char*>(m_region.malloc(n));
+        if (n > m_size - sizeof(Chunk)) { // big memory request
+            size_t bytes = m_region.bytes();
+            Chunk* big = static_cast<Chunk*>
+                (m_region.malloc(sizeof(Chunk) + n));
+            big->prev = m_big;
+            m_big = big;
+            ptr = reinterpret_cast<char*>(big + 1);
+            m_stats.grown(1, m_region.bytes() - bytes);
         } else {
-            if (m_cur + n > m_end) { // discard what is left in this page
-                m_cur = static_cast<char*>(m_region.malloc(s_size));
-                m_end = m_cur + s_size;
-            }            
+            if (m_cur + n > m_end) // discard what is left in this page
+                nextChunk();
             ptr = m_cur;
             m_cur += n;
         }
+        m_stats.use(n);
         
         if (zero)
             memset(ptr, 0, n);
         return ptr;
     }
 
+    void Bin::nextChunk()
+    {
+        if (m_chunk != NULL)
+            m_stats.wasted += m_end - m_cur;
+        Chunk* chunk = m_spare;
+        if (chunk != NULL) {
+            m_spare = chunk->prev;
+        } else {
+            size_t bytes = m_region.bytes();
+            chunk = static_cast<Chunk*>(m_region.malloc(m_size));
+            m_stats.grown(1, m_region.bytes() - bytes);
+        }
+        chunk->prev = m_chunk;
+        m_chunk = chunk;
+        m_cur = reinterpret_cast<char*>(chunk + 1);
+        m_end = reinterpret_cast<char*>(chunk) + m_size;
+    }
+
+    Bin::Mark Bin::mark() const
+    {
+        Mark m;
+        m.chunk = m_chunk;
+        m.cur = m_cur;
+        m.big = m_big;
+        m.used = m_stats.inUse;
+        m.wasted = m_stats.wasted;
+        return m;
+    }
+
+    void Bin::rewind(const Mark& m)
+    {
+        while (m_chunk != m.chunk) { // keep the chunks for reuse
+            Chunk* chunk = m_chunk;
+            m_chunk = chunk->prev;
+            chunk->prev = m_spare;
+            m_spare = chunk;
+        }
+        m_cur = m.cur;
+        m_end = reinterpret_cast<char*>(m_chunk) + m_size;
+        while (m_big != m.big) {
+            Chunk* big = m_big;
+            m_big = big->prev;
+            size_t bytes = m_region.bytes();
+            m_region.free(big);
+            m_stats.shrunk(1, bytes - m_region.bytes());
+        }
+        m_stats.inUse = m.used;
+        m_stats.wasted = m.wasted;
+    }
+
+    void Bin::reset()
+    {
+        Mark m;
+        m.chunk = m_first;
+        m.cur = reinterpret_cast<char*>(m_first + 1);
+        m.big = NULL;
+        m.used = 0;
+        m.wasted = 0;
+        rewind(m);
+    }
+
     char* Bin::strdup(const char* str)
     {
         size_t size = strlen(str) + 1;
@@ -67,4 +339,107 @@ namespace ate {
 
     Bin::~Bin() {}
 
+    SlabAllocator::SlabAllocator(const char* name, size_t chunkSize)
+        : m_name(name), m_chunkSize(chunkSize), m_stats(name)
+    {
+        size_t size = MIN_SIZE;
+        for (size_t i = 0; i < CLASS_COUNT; ++i) {
+            SizeClass& sc = m_classes[i];
+            sc.head = NULL;
+            memset(&sc.stats, 0, sizeof(sc.stats));
+            sc.stats.blockSize = size;
+            // 32, 48, 64, 96, 128, ...: every other class is 1.5 times
+            size = (i % 2 == 0) ? size + size / 2 : size / 3 * 4; 
+        }
+        memset(&m_large, 0, sizeof(m_large));
+    }
+
+    SlabAllocator::~SlabAllocator() {} // regions release the small blocks
+
+    size_t SlabAllocator::sizeClass(size_t n)
+    {
+        if (n <= MIN_SIZE)
+            return 0;
+        // n is in (2^p, 2^(p+1)]
+        size_t p = sizeof(unsigned long) * 8 - 1 - 
+            __builtin_clzl((unsigned long)(n - 1));
+        size_t half = ((size_t)3) << (p - 1);
+        return 2 * (p - 5) + (n <= half ? 1 : 2);
+    }
+    
+    void* SlabAllocator::malloc(size_t n)
+    {
+        if (n > MAX_SIZE)
+            return mallocLarge(n);
+        size_t i = sizeClass(n);
+        SizeClass& sc = m_classes[i];
+        if (sc.head == NULL) 
+            grow(sc);
+        Block* block = sc.head;
+        sc.head = block->next;
+        block->header.tag = i;
+        if (++sc.stats.inUse > sc.stats.peak)
+            sc.stats.peak = sc.stats.inUse;
+        m_stats.use(1);
+        return &block->header + 1;
+    }
+
+    void SlabAllocator::free(void* ptr)
+    {
+        if (ptr == NULL)
+            return;
+        Header* header = static_cast<Header*>(ptr) - 1;
+        size_t tag = header->tag;
+        if (tag >= CLASS_COUNT) { // mapped length of a large block
+            if (munmap(header, tag) != 0)
+                ATE_ABORT(m_name << " munmap() failed");
+            --m_large.inUse;
+            m_large.blockSize -= tag;
+            m_stats.unuse(1);
+            m_stats.shrunk(1, tag);
+            return;
+        }
+        SizeClass& sc = m_classes[tag];
+        Block* block = reinterpret_cast<Block*>(header);
+        block->next = sc.head;
+        sc.head = block;
+        --sc.stats.inUse;
+        m_stats.unuse(1);
+    }
+
+    void SlabAllocator::grow(SizeClass& sc)
+    {
+        size_t blockSize = sizeof(Header) + sc.stats.blockSize;
+        size_t nBlocks = m_chunkSize / blockSize;
+        if (nBlocks < 4)
+            nBlocks = 4;
+        size_t bytes = sc.region.bytes();
+        char* cur = static_cast<char*>(sc.region.malloc(blockSize * nBlocks));
+        for (size_t i = 0; i < nBlocks; ++i) {
+            Block* block = reinterpret_cast<Block*>(cur);
+            block->next = sc.head;
+            sc.head = block;
+            cur += blockSize;
+        }
+        sc.stats.capacity += nBlocks;
+        m_stats.grown(nBlocks, sc.region.bytes() - bytes);
+    }
+
+    void* SlabAllocator::mallocLarge(size_t n)
+    {
+        size_t len = (sizeof(Header) + n + 4095) & ~((size_t)4095);
+        void* mem = mmap(NULL, len, PROT_READ | PROT_WRITE, 
+                         MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (mem == MAP_FAILED)
+            ATE_ABORT(m_name << " mmap() failed: " << len);
+        Header* header = static_cast<Header*>(mem);
+        header->tag = len;
+        if (++m_large.inUse > m_large.peak)
+            m_large.peak = m_large.inUse;
+        m_large.blockSize += len;
+        m_stats.use(1);
+        m_stats.grown(1, len);
+        return header + 1;
+    }
+
 } // namespace ate
@@ -0,0 +1,174 @@
+#include <ate/ate.hpp>
+#include <time.h>
+#if defined(__i386__) || defined(__x86_64__)
+#include <cpuid.h>
+#endif
+
+namespace {
+    const uint64_t NANOS_PER_SEC = 1000000000;
+    // calibration interval at first use
+    const uint64_t calibrateNanos = 10000000;
+
+    uint64_t readClock(clockid_t id)
+    {
+        timespec ts;
+        if (clock_gettime(id, &ts) != 0)
+            ATE_ABORT("clock_gettime() failed: " << id);
+        return ts.tv_sec * NANOS_PER_SEC + ts.tv_nsec;
+    }
+
+    /// TSC runs at a constant rate in all C/P states, cpuid 80000007h EDX[8]
+    bool invariantTsc()
+    {
+#if defined(__i386__) || defined(__x86_64__)
+        unsigned int a, b, c, d;
+        if (__get_cpuid(0x80000000, &a, &b, &c, &d) == 0 || a < 0x80000007)
+            return false;
+        __get_cpuid(0x80000007, &a, &b, &c, &d);
+        return (d & (1 << 8)) != 0;
+#else
+        return false;
+#endif
+    }
+
+    /// TSC and CLOCK_MONOTONIC read at about the same time: the TSC is 
+    /// the middle of two reads around clock_gettime()
+    void sample(uint64_t& ticks, uint64_t& mono)
+    {
+        uint64_t before = ate::getClockTicks();
+        mono = readClock(CLOCK_MONOTONIC);
+        ticks = before + (ate::getClockTicks() - before) / 2;
+    }
+
+    ate::SpinLock calibrateLock;
+    bool calibrated = false;
+    // first sample, the scale is computed over the whole time since then
+    uint64_t originTicks;
+    uint64_t originMono;
+    uint64_t ticksPerSec = 0;
+}
+
+namespace ate {
+    Clock::Base Clock::s_base = { 0, false, 0, 0, 0, 0, 0, 0, 0 };
+    __thread uint64_t Clock::s_cached = 0;
+
+    void Clock::calibrate()
+    {
+        LockGuard<SpinLock> guard(calibrateLock);
+        if (calibrated)
+            return;
+        int seq = s_base.seq;
+        while ((seq & 1) != 0 || cmpAndSwap(&s_base.seq, seq, seq + 1) != seq)
+            seq = s_base.seq;
+        if (invariantTsc()) {
+            uint64_t ticks;
+            uint64_t mono;
+            sample(originTicks, originMono);
+            do {
+                sample(ticks, mono);
+            } while (mono - originMono < calibrateNanos);
+            s_base.tsc = ticks > originTicks;
+        }
+        s_base.resyncTicks = 0; // the next read resyncs
+        releaseFence();
+        s_base.seq = seq + 2;
+        calibrated = true;
+    }
+
+    bool Clock::tsc()
+    {
+        if (!calibrated)
+            calibrate();
+        return s_base.tsc;
+    }
+
+    uint64_t Clock::ticksPerSecond()
+    {
+        if (!calibrated)
+            calibrate();
+        if (!s_base.tsc)
+            return 0;
+        readSlow(false); // make sure the scale is computed
+        return ticksPerSec;
+    }
+
+    NanoTime Clock::toWall(const NanoTime& mono)
+    {
+        for (;;) {
+            int seq = s_base.seq;
+            acquireFence();
+            uint64_t offset = s_base.wall - s_base.mono;
+            bool tsc = s_base.tsc;
+            acquireFence();
+            if (seq != s_base.seq || (seq & 1) != 0)
+                continue;
+            if (!tsc || s_base.mult == 0) 
+                offset = readClock(CLOCK_REALTIME) - readClock(CLOCK_MONOTONIC);
+            return NanoTime(mono.nanosec + offset);
+        }
+    }
+
+    timespec Clock::toSystem(const MicroTime& mono)
+    {
+        uint64_t nanos = mono.microsec * 1000;
+        if (tsc()) { // move it by the TSC clock's offset right now
+            uint64_t system = readClock(CLOCK_MONOTONIC);
+            uint64_t ours = read(false);
+            if (ours > nanos + system)
+                nanos = 0; // long past
+            else
+                nanos = nanos + system - ours;
+        }
+        timespec ts;
+        ts.tv_sec = nanos / NANOS_PER_SEC;
+        ts.tv_nsec = nanos % NANOS_PER_SEC;
+        return ts;
+    }
+
+    uint64_t Clock::readSlow(bool wall)
+    {
+        if (!calibrated)
+            calibrate();
+        if (!s_base.tsc)
+            return readClock(wall ? CLOCK_REALTIME : CLOCK_MONOTONIC);
+        int seq = s_base.seq;
+        if ((seq & 1) != 0 || cmpAndSwap(&s_base.seq, seq, seq + 1) != seq)
+            return read(wall); // another thread resyncs, use its result
+        uint64_t ticks;
+        uint64_t mono;
+        sample(ticks, mono);
+        uint64_t now = readClock(CLOCK_REALTIME);
+        // the base follows CLOCK_MONOTONIC. Times read before this resync 
+        // may be a little ahead of it, they only raise the floor.
+        uint64_t floor = s_base.floor;
+        if (s_base.mult != 0) {
+            uint64_t estimate = s_base.mono + 
+                scale(ticks - s_base.ticks, s_base.mult, s_base.shift);
+            if (estimate > floor)
+                floor = estimate;
+        }
+        // nanoseconds per tick as mult >> shift, mult < 2^32, from kernel 
+        // readings only, so its error shrinks as the time since the 
+        // origin grows
+        double nanosPerTick = (double)(mono - originMono) / 
+            (ticks - originTicks);
+        uint32_t shift = 32;
+        while (shift > 0 && nanosPerTick * ((uint64_t)1 << shift) >= 
+               4294967296.0)
+            --shift;
+        ticksPerSec = (uint64_t)(NANOS_PER_SEC / nanosPerTick);
+        s_base.mult = (uint32_t)(nanosPerTick * ((uint64_t)1 << shift));
+        s_base.shift = shift;
+        s_base.ticks = ticks;
+        s_base.mono = mono;
+        s_base.wall = now;
+        s_base.floor = floor;
+        // once a second, sooner while the scale is young: each resync 
+        // at least halves its error
+        s_base.resyncTicks = ticks - originTicks < ticksPerSec ? 
+            ticks - originTicks : ticksPerSec;
+        releaseFence();
+        s_base.seq = seq + 2;
+        return wall ? now : (mono > floor ? mono : floor);
+    }
+}
@@ -1,107 +1,473 @@
 #include <ate/ate.hpp>
 
 namespace {
+    template <typename Loop>
     bool stopLoop(const ate::Timer& timer)
     {
-        using ate::EventLoop;
-        using ate::Event;
-        EventLoop* evloop = static_cast<EventLoop*>(timer.aux);
+        Loop* evloop = static_cast<Loop*>(timer.aux);
         evloop->setRunning(false);
         return true; // done
     }
+
+    /// the group whose loop runs on this thread, if any
+    __thread const void* currentGroup = NULL;
 }
 
 namespace ate {    
-    void TimerQueue::doAdd(TimerNode* newNode)
+    namespace {
+        /// the first tick at or after time
+        inline uint64_t toTick(const MicroTime& time, int shift)
+        {
+            uint64_t mask = ((uint64_t)1 << shift) - 1;
+            return (time.microsec >> shift) + ((time.microsec & mask) != 0);
+        }
+    }
+
+    TimerQueue::TimerQueue(const char* name, size_t maxTimers)
+        : m_name(name), m_pool(m_name, maxTimers), 
+          m_posted(NULL), m_postedPool(m_name), m_count(0), m_seq(0)
     {
-        TimerNode* tn;
-        for (tn = m_dummy.prev; tn != &m_dummy; tn = tn->prev) {
-            if (newNode->timer.time >= tn->timer.time)
-                break;
+        for (size_t i = 0; i < LEVELS * SLOTS; ++i)
+            m_slots[i].next = m_slots[i].prev = &m_slots[i];
+        for (size_t i = 0; i < LEVELS; ++i)
+            m_occupied[i] = 0;
+        m_stats.fired = 0;
+        m_stats.lateMicros = 0;
+        m_stats.maxLateMicros = 0;
+        m_tick = MicroTime::monotonic().microsec >> TICK_SHIFT;
+    }
+
+    void TimerQueue::link(TimerNode* node)
+    {
+        if (node->tick < m_tick) // expired already
+            node->tick = m_tick;
+        size_t level = 0;
+        uint64_t diff = node->tick ^ m_tick;
+        if (diff != 0) // the highest group that differs
+            level = (63 - __builtin_clzll(diff)) / SLOT_BITS;
+        size_t slot = (node->tick >> (level * SLOT_BITS)) & (SLOTS - 1);
+        node->slot = level * SLOTS + slot;
+        Link* head = &m_slots[node->slot];
+        node->next = head;
+        node->prev = head->prev;
+        head->prev->next = node;
+        head->prev = node;
+        m_occupied[level] |= (uint64_t)1 << slot;
+    }
+
+    void TimerQueue::unlink(TimerNode* node)
+    {
+        node->prev->next = node->next;
+        node->next->prev = node->prev;
+        Link* head = &m_slots[node->slot];
+        if (head->next == head) {
+            m_occupied[node->slot / SLOTS] &= 
+                ~((uint64_t)1 << (node->slot % SLOTS));
         }
-        newNode->prev = tn;
-        newNode->next = tn->next;        
-        newNode->prev->next = newNode->next->prev = newNode;
+    }
+
+    TimerQueue::TimerNode* TimerQueue::find(Handle h) const
+    {
+        TimerNode* node = m_pool.get((HandlePool<TimerNode>::Handle)h);
+        if (node == NULL || node->seq != (uint32_t)(h >> 32))
+            return NULL;
+        return node;
+    }
+
+    bool TimerQueue::nextSlot(size_t& level, size_t& slot, 
+                              uint64_t& tick) const
+    {
+        // every timer of a level expires before those of the next level,
+        // and no slot is behind the current tick
+        for (level = 0; level < LEVELS; ++level) {
+            if (m_occupied[level] != 0) {
+                slot = __builtin_ctzll(m_occupied[level]);
+                size_t shift = level * SLOT_BITS;
+                tick = ((m_tick >> shift) & ~(uint64_t)(SLOTS - 1)) | slot;
+                tick <<= shift;
+                return true;
+            }
+        }
+        return false;
+    }
+
+    MicroTime TimerQueue::minTime() const
+    {
+        MicroTime mt; // max
+        size_t level;
+        size_t slot;
+        uint64_t tick;
+        if (nextSlot(level, slot, tick))
+            mt.microsec = tick << TICK_SHIFT;
+        return mt;
     }
     
-    void TimerQueue::add(const Timer& timer)
+    TimerQueue::Handle TimerQueue::add(const Timer& timer)
     {        
-        TimerNode* newNode = m_pool.alloc();
+        HandlePool<TimerNode>::Handle ph = m_pool.alloc();
+        TimerNode* newNode = m_pool[ph];
+        newNode->seq = ++m_seq;
         new(&newNode->timer) Timer(timer); // copy by default copy constructor
-        doAdd(newNode);
+        newNode->tick = toTick(timer.time, TICK_SHIFT);
+        link(newNode);
+        ++m_count;
+        return ((Handle)newNode->seq << 32) | ph;
+    }
+
+    bool TimerQueue::cancel(Handle h)
+    {
+        TimerNode* node = find(h);
+        if (node == NULL || node->slot == CANCELLED)
+            return false;
+        if (node->slot == FIRING || node->slot == RESCHEDULED) {
+            node->slot = CANCELLED; // dispatch() frees it
+            return true;
+        }
+        unlink(node);
+        m_pool.dealloc((HandlePool<TimerNode>::Handle)h);
+        --m_count;
+        return true;
+    }
+
+    bool TimerQueue::reschedule(Handle h, const MicroTime& time)
+    {
+        TimerNode* node = find(h);
+        if (node == NULL || node->slot == CANCELLED)
+            return false;
+        node->timer.time = time;
+        node->tick = toTick(time, TICK_SHIFT);
+        if (node->slot == FIRING || node->slot == RESCHEDULED) {
+            node->slot = RESCHEDULED; // dispatch() links it
+            return true;
+        }
+        unlink(node);
+        link(node);
+        return true;
+    }
+
+    bool TimerQueue::post(const Timer& timer)
+    {
+        PostedTimer* posted = m_postedPool.alloc();
+        new(&posted->timer) Timer(timer);
+        void* head;
+        do { // addPosted() always takes the whole list, so no ABA
+            head = m_posted;
+            posted->next = static_cast<PostedTimer*>(head);
+        } while (cmpAndSwapPtr(reinterpret_cast<void* volatile*>(&m_posted),
+                               head, posted) != head);
+        return head == NULL;
+    }
+
+    void TimerQueue::addPosted()
+    {
+        if (m_posted == NULL)
+            return;
+        PostedTimer* posted = static_cast<PostedTimer*>(fetchAndStorePtr(
+            reinterpret_cast<void* volatile*>(&m_posted), NULL));
+        PostedTimer* fifo = NULL;
+        while (posted != NULL) { // reverse the LIFO list
+            PostedTimer* next = posted->next;
+            posted->next = fifo;
+            fifo = posted;
+            posted = next;
+        }
+        while (fifo != NULL) {
+            PostedTimer* next = fifo->next;
+            add(fifo->timer);
+            m_postedPool.dealloc(fifo);
+            fifo = next;
+        }
     }
     
     void TimerQueue::dispatch(const MicroTime& now)
     {        
-        TimerNode* cbNode;
-        while ((cbNode = m_dummy.next) != &m_dummy &&
-               cbNode->timer.time <= now) {
-            m_dummy.next = cbNode->next;
-            m_dummy.next->prev = &m_dummy;
-            if (cbNode->timer.tcb(cbNode->timer)) { // done. remove
-                m_pool.dealloc(cbNode);
-            } else { // recurrent timer, add it back to the list
-                cbNode->timer.time.add(cbNode->timer.increment);
-                doAdd(cbNode);
+        uint64_t target = now.microsec >> TICK_SHIFT;
+        size_t level;
+        size_t slot;
+        uint64_t tick;
+        while (nextSlot(level, slot, tick) && tick <= target) {
+            m_tick = tick;
+            Link* head = &m_slots[level * SLOTS + slot];
+            while (head->next != head) {
+                TimerNode* node = static_cast<TimerNode*>(head->next);
+                unlink(node);
+                if (level != 0) { // move it down to a lower level
+                    link(node);
+                    continue;
+                }
+                uint64_t late = now.microsec > node->timer.time.microsec ?
+                    now.microsec - node->timer.time.microsec : 0;
+                ++m_stats.fired;
+                m_stats.lateMicros += late;
+                if (late > m_stats.maxLateMicros)
+                    m_stats.maxLateMicros = late;
+                node->slot = FIRING;
+                bool done = node->timer.tcb(node->timer);
+                if (node->slot == RESCHEDULED) { // by the callback
+                    link(node);
+                } else if (done || node->slot == CANCELLED) { // remove
+                    m_pool.dealloc(m_pool.handleOf(node));
+                    --m_count;
+                } else { // recurrent timer, add it back 
+                    node->timer.time.add(node->timer.increment);
+                    node->tick = toTick(node->timer.time, TICK_SHIFT);
+                    link(node);
+                }
             }
         }
+        if (target > m_tick)
+            m_tick = target;
     }
     
-    EventLoop::EventLoop() : m_running(true), m_evq(m_monitor, "EventQueue")
+    template <typename Queue>
+    BasicEventLoop<Queue>::BasicEventLoop(size_t maxTimers) 
+        : m_running(true), m_timers("TimerQueue", maxTimers),
+          m_evq(m_monitor, "EventQueue"), m_parked(0),
+          m_strategy(BLOCK), m_spins(0), m_yields(0), m_maxEvents(0),
+          m_maxMicros(0), m_cappedCycles(0), m_pending(NULL)
     {
     }
     
-    void EventLoop::push(const Event& event)
+    template <typename Queue>
+    void BasicEventLoop<Queue>::push(const Event& event)
     {
         m_evq.push(event);
     }
     
-    void EventLoop::addTimer(const Timer& timer)
+    template <typename Queue>
+    TimerHandle BasicEventLoop<Queue>::addTimer(const Timer& timer)
     {
-        m_timers.add(timer);
+        return m_timers.add(timer);
+    }
+
+    template <typename Queue>
+    void BasicEventLoop<Queue>::postTimer(const Timer& timer)
+    {
+        // the loop checks hasPosted() with the monitor held before it 
+        // waits, so this notify() cannot be lost
+        if (m_timers.post(timer)) {
+            LockGuard<Monitor> guard(m_monitor);
+            m_monitor.notify();
+        }
     }
     
-    EventNode* EventLoop::getWork(const MicroTime& now, bool& waited)
+    template <typename Queue> typename BasicEventLoop<Queue>::Node* 
+    BasicEventLoop<Queue>::getWork(const MicroTime& now, bool& waited)
     {
         LockGuard<Monitor> guard(m_monitor);
         if (now >= m_timers.minTime()) { 
             waited = false;
             return NULL;
         }
-        EventNode* en = (EventNode*)m_evq.getWorkWithLock(m_timers.minTime());
+        MicroTime deadline = m_timers.minTime();
+        if (m_timers.hasPosted())
+            deadline.setMin();
+        if (!m_sources.empty()) {
+            // a push after this sees m_parked and calls notify()
+            exchange(&m_parked, 1);
+            for (size_t i = 0; i < m_sources.size(); ++i) {
+                if (!m_sources[i]->empty()) { // poll the queue only
+                    deadline.setMin();
+                    break;
+                }
+            }
+        }
+        Node* en = m_evq.getWorkWithLock(deadline);
+        m_parked = 0;
         if (en == NULL) // time out from condition wait
             waited = true;
         return en;
     }
+
+    template <typename Queue>
+    bool BasicEventLoop<Queue>::spinForWork(MicroTime& now)
+    {
+        MicroTime deadline = m_timers.minTime();
+        int i = 0; // only counts up to m_spins + m_yields
+        while (m_running) {
+            if (!m_evq.empty() || now >= deadline || m_timers.hasPosted())
+                return true;
+            for (size_t j = 0; j < m_sources.size(); ++j) {
+                if (!m_sources[j]->empty())
+                    return true;
+            }
+            if (m_strategy == BUSY_SPIN) {
+                cpuPause();
+            } else if (i < m_spins) {
+                cpuPause();
+                ++i;
+            } else if (i < m_spins + m_yields) {
+                Thread::yield();
+                ++i;
+            } else { // park in getWork()
+                return true;
+            }
+            now = Clock::update().toMicroTime();
+        }
+        return false;
+    }
+
+    template <typename Queue> typename BasicEventLoop<Queue>::Node* 
+    BasicEventLoop<Queue>::dispatchEvents(Node* en)
+    {
+        if (m_maxEvents == 0 && m_maxMicros == 0) { // no limits
+            for (; en != NULL; en = en->next)
+                en->obj.handler->onEvent(en->obj);
+            return NULL;
+        }
+        size_t maxEvents = m_maxEvents != 0 ? m_maxEvents : (size_t)-1;
+        uint64_t deadline = (uint64_t)-1;
+        if (m_maxMicros != 0) 
+            deadline = NanoTime::monotonic().nanosec + 
+                (uint64_t)m_maxMicros * 1000;
+        for (size_t n = 0; en != NULL; en = en->next, ++n) {
+            // read the clock every 16 events only
+            if (n == maxEvents || ((n & 15) == 15 && 
+                NanoTime::monotonic().nanosec >= deadline)) {
+                ++m_cappedCycles;
+                return en;
+            }
+            en->obj.handler->onEvent(en->obj);
+        }
+        return NULL;
+    }
+
+    template <typename Queue>
+    void BasicEventLoop<Queue>::dispatchSources()
+    {
+        Event events[64];
+        for (size_t i = 0; i < m_sources.size(); ++i) {
+            size_t n = m_sources[i]->tryPopN(events, 64);
+            for (size_t j = 0; j < n; ++j)
+                events[j].handler->onEvent(events[j]);
+        }
+    }
     
-    void EventLoop::run(int millis)
+    template <typename Queue>
+    void BasicEventLoop<Queue>::run(int millis)
     {
         m_running = true;
+        Thread::setTimerSlack(1000);
         bool waited;        
-        EventNode* eventList;
+        Node* eventList;
         if (millis > 0) {
             Timer timer;
-            timer.time = MicroTime::now().add(millis);
+            timer.time = MicroTime::monotonic().add(millis);
             timer.increment = millis;
-            timer.tcb = stopLoop;
+            timer.tcb = stopLoop<BasicEventLoop>;
             timer.aux = this;
             m_timers.add(timer);
         }
         MicroTime now;
         while (m_running) { // dispatch timers and events
-            now = MicroTime::now();
+            // handlers read NanoTime::cached()
+            now = Clock::update().toMicroTime();
+            m_timers.addPosted();
+            if (m_pending != NULL) { 
+                // the queue keeps the batch until the next getWork(), so 
+                // finish it first, with the due timers in between
+                begin();
+                if (now >= m_timers.minTime())
+                    m_timers.dispatch(now);
+                m_pending = dispatchEvents(m_pending);
+                dispatchSources();
+                end();
+                continue;
+            }
+            if (m_strategy != BLOCK && !spinForWork(now))
+                break;
             eventList = getWork(now, waited);
             begin();
             if (eventList == NULL) { // some timer expired
                 if (waited) 
-                    now = MicroTime::now();
+                    now = MicroTime::monotonic();
                 m_timers.dispatch(now);
             } else { // got some work from event queue
-                for (EventNode* en = eventList; en != NULL; en = en->next) {
-                    en->obj.handler->onEvent(en->obj);
-                }
+                m_pending = dispatchEvents(eventList);
             }
+            dispatchSources();
             end();
         }
     }
+
+    template <typename Loop>
+    BasicEventLoopGroup<Loop>::BasicEventLoopGroup(size_t nLoops, 
+                                                   const std::vector<int>& cpus,
+                                                   size_t maxTimers)
+        : m_cpus(cpus)
+    {
+        ATE_ASSERT(nLoops > 0);
+        for (size_t i = 0; i < nLoops; ++i) {
+            m_loops.push_back(new Loop(maxTimers));
+            StopRequest stop = {m_loops.back(), false};
+            m_stops.push_back(stop);
+        }
+    }
+
+    template <typename Loop>
+    BasicEventLoopGroup<Loop>::~BasicEventLoopGroup()
+    {
+        stop();
+        for (size_t i = 0; i < m_loops.size(); ++i)
+            delete m_loops[i];
+    }
+
+    template <typename Loop>
+    void BasicEventLoopGroup<Loop>::start()
+    {
+        ATE_ASSERT(currentGroup != this);
+        LockGuard<Mutex> guard(m_mutex);
+        ATE_ASSERT(m_threads.empty());
+        for (size_t i = 0; i < m_loops.size(); ++i) {
+            int cpu = m_cpus.empty() ? -1 : m_cpus[i % m_cpus.size()];
+            m_threads.push_back(new LoopThread(this, *m_loops[i], cpu));
+            m_threads.back()->start();
+        }
+    }
+
+    template <typename Loop>
+    void BasicEventLoopGroup<Loop>::stop()
+    {
+        // a loop thread would join itself
+        ATE_ASSERT(currentGroup != this);
+        LockGuard<Mutex> guard(m_mutex);
+        Timer timer;
+        timer.time.setMin(); // fires in the next cycle
+        timer.increment = -1;
+        timer.tcb = onStop;
+        for (size_t i = 0; i < m_threads.size(); ++i) {
+            m_stops[i].requested = true;
+            timer.aux = &m_stops[i];
+            m_loops[i]->postTimer(timer);
+        }
+        for (size_t i = 0; i < m_threads.size(); ++i) {
+            m_threads[i]->join();
+            delete m_threads[i];
+            m_stops[i].requested = false;
+        }
+        m_threads.clear();
+    }
+
+    template <typename Loop>
+    bool BasicEventLoopGroup<Loop>::onStop(const Timer& timer)
+    {
+        StopRequest* stop = static_cast<StopRequest*>(timer.aux);
+        if (stop->requested) // not left over from an earlier stop()
+            stop->loop->setRunning(false);
+        return true;
+    }
+
+    template <typename Loop>
+    void BasicEventLoopGroup<Loop>::LoopThread::run()
+    {
+        currentGroup = m_group;
+        if (m_cpu >= 0)
+            Thread::setAffinity(m_cpu);
+        m_loop.run();
+    }
+
+    template class BasicEventLoop<EventQueue>;
+    template class BasicEventLoop<MpscEventQueue>;
+    template class BasicEventLoopGroup<EventLoop>;
+    template class BasicEventLoopGroup<MpscEventLoop>;
 }
@@ -2,38 +2,6 @@
 
 #include <ctype.h>
 
-// strsep() implementaion for where it is missing, taken from bsd source.
-#ifdef __sun 
-/* 
- * Copyright (c) 1990, 1993
- * The Regents of the University of California.  All rights reserved.
- */
-char* strsep(char **stringp, const char *delim)
-{
-    register char *s;
-    register const char *spanp;
-    register int c, sc;
-    char *tok;
-    
-    if ((s = *stringp) == NULL)
-        return (NULL);
-    for (tok = s; ; ) {
-        c = *s++;
-        spanp = delim;
-        do {
-            if ((sc = *spanp++) == c) {
-                if (c == 0)
-                    s = NULL;
-                else
-                    s[-1] = 0;
-                *stringp = s;
-                return (tok);
-            }
-        } while (sc != 0);
-    }
-}
-#endif  // end of __sun: strsetp() implemenation
-
 namespace ate {
     char* trimLeft(char* str, const char* delim)
     {
@@ -84,19 +52,4 @@ namespace ate {
             ++str;
         }
     }
-
-    void tokenize(std::vector<char*>& tokens, char* str, const char* delim)
-    {
-        char* saveptr;
-        for (char* token = strtok_r(str, delim, &saveptr); token != NULL;
-             token = strtok_r(NULL, delim, &saveptr)) 
-            tokens.push_back(token);
-    }
-
-    void split(std::vector<char*>& tokens, char* str, const char* delim)
-    {
-        char* token;
-        while ((token = strsep(&str, delim)) != NULL)
-            tokens.push_back(token);
-    }
 }
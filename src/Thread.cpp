@@ -1,11 +1,33 @@
 #include <ate/ate.hpp>
 
 #include <time.h>
+#include <sys/prctl.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
+#include <limits.h>
+#include <unistd.h>
 
 namespace {
     const unsigned int pauseCountMax = 32;
     const unsigned int yieldCountMax = 8;
     const unsigned int sleepCountMax = 512;
+    // FastMutex spins about a microsecond before it parks
+    const unsigned int mutexSpinMax = 100;
+
+    long futex(volatile int* addr, int op, int val, 
+               const struct timespec* timeout = NULL)
+    {
+        return syscall(SYS_futex, addr, op, val, timeout, NULL, 
+                       FUTEX_BITSET_MATCH_ANY);
+    }
+
+    // spinning only helps when the holder runs on another cpu
+    unsigned int mutexSpin()
+    {
+        static unsigned int spin = sysconf(_SC_NPROCESSORS_ONLN) > 1 ? 
+            mutexSpinMax : 0;
+        return spin;
+    }
 
     void* threadFunc(void* param)
     {
@@ -63,6 +85,20 @@ namespace ate {
         }
     }
     
+    void Thread::setTimerSlack(unsigned long nanos)
+    {
+        ATE_ASSERT(prctl(PR_SET_TIMERSLACK, nanos, 0, 0, 0) == 0);
+    }
+
+    void Thread::setAffinity(int cpu)
+    {
+        cpu_set_t cpus;
+        CPU_ZERO(&cpus);
+        CPU_SET(cpu, &cpus);
+        ATE_ASSERT(pthread_setaffinity_np(pthread_self(), sizeof(cpus), 
+                                          &cpus) == 0);
+    }
+    
     void SpinLock::lock()
     {
         unsigned int pauseCount = 1;
@@ -92,10 +128,179 @@ namespace ate {
     
     void SpinLock::unlock()
     {
-        membar();
+        releaseFence();
         m_lock.locked = 0;
     }
     
+    void TicketLock::lock()
+    {
+        int ticket = fetchAndAdd(&m_next, 1);
+        unsigned int pauseCount = 0;
+        while (m_serving != ticket) {
+            // a waiter can not take the lock out of turn, so the holder 
+            // and the waiters ahead must get the cpu
+            if (pauseCount++ < pauseCountMax)
+                cpuPause((unsigned int)ticket - (unsigned int)m_serving);
+            else
+                Thread::yield();
+        }
+        acquireFence();
+    }
+
+    __thread McsLock::Node McsLock::s_nodes[McsLock::MAX_HELD];
+    __thread McsLock::Node* McsLock::s_free = NULL;
+    __thread bool McsLock::s_init = false;
+
+    McsLock::Node* McsLock::allocNode()
+    {
+        if (!s_init) {
+            for (int i = 0; i < MAX_HELD; ++i)
+                freeNode(&s_nodes[i]);
+            s_init = true;
+        }
+        Node* node = s_free;
+        if (node == NULL)
+            ATE_ABORT("a thread holds more than " << MAX_HELD << " McsLocks");
+        s_free = node->free;
+        node->next = NULL;
+        node->locked = 1;
+        return node;
+    }
+
+    void McsLock::lock()
+    {
+        Node* node = allocNode();
+        Node* prev = static_cast<Node*>(
+            fetchAndStorePtr(reinterpret_cast<void* volatile*>(&m_tail), 
+                             node));
+        if (prev != NULL) { // wait for prev to hand over
+            prev->next = node;
+            unsigned int pauseCount = 0;
+            while (node->locked) {
+                if (pauseCount++ < pauseCountMax)
+                    cpuPause();
+                else
+                    Thread::yield();
+            }
+        }
+        acquireFence();
+        m_owner = node;
+    }
+
+    bool McsLock::tryLock()
+    {
+        if (m_tail != NULL)
+            return false;
+        Node* node = allocNode();
+        if (cmpAndSwapPtr(reinterpret_cast<void* volatile*>(&m_tail), 
+                          NULL, node) != NULL) {
+            freeNode(node);
+            return false;
+        }
+        m_owner = node;
+        return true;
+    }
+
+    void McsLock::unlock()
+    {
+        Node* node = m_owner;
+        if (node->next == NULL) {
+            if (cmpAndSwapPtr(reinterpret_cast<void* volatile*>(&m_tail), 
+                              node, NULL) == node) {
+                freeNode(node);
+                return;
+            }
+            // a successor is linking itself
+            unsigned int pauseCount = 0;
+            while (node->next == NULL) {
+                if (pauseCount++ < pauseCountMax)
+                    cpuPause();
+                else
+                    Thread::yield();
+            }
+        }
+        releaseFence();
+        node->next->locked = 0;
+        freeNode(node);
+    }
+
+    void RWSpinLock::lock()
+    {
+        unsigned int pauseCount = 0;
+        for (;;) {
+            int state = m_state;
+            if ((state & ~WAITING) == 0) { // no reader, no writer
+                if (cmpAndSwap(&m_state, state, WRITER) == state)
+                    return;
+            } else if ((state & WAITING) == 0) { // keep new readers out
+                cmpAndSwap(&m_state, state, state | WAITING);
+            }
+            if (pauseCount++ < pauseCountMax)
+                cpuPause();
+            else
+                Thread::yield();
+        }
+    }
+
+    void RWSpinLock::readLockSlow()
+    {
+        unsigned int pauseCount = 0;
+        for (;;) {
+            int state = m_state;
+            if ((state & (WRITER | WAITING)) == 0 && 
+                cmpAndSwap(&m_state, state, state + READER) == state)
+                return;
+            if (pauseCount++ < pauseCountMax)
+                cpuPause();
+            else
+                Thread::yield();
+        }
+    }
+
+    void FastMutex::lockSlow()
+    {
+        for (unsigned int i = mutexSpin(); i > 0; --i) {
+            cpuPause();
+            if (m_state == 0 && cmpAndSwap(&m_state, 0, 1) == 0)
+                return;
+        }
+        // 2 tells unlock() to wake someone up
+        while (exchange(&m_state, 2) != 0)
+            futex(&m_state, FUTEX_WAIT_PRIVATE, 2);
+    }
+
+    void FastMutex::unlockSlow()
+    {
+        m_state = 0;
+        futex(&m_state, FUTEX_WAKE_PRIVATE, 1);
+    }
+
+    int FastCondition::timedWait(FastMutex& mutex, const MicroTime& mt)
+    {
+        fetchAndAdd(&m_waiters, 1);
+        int seq = m_seq;
+        mutex.unlock();
+        int rc = 0;
+        if (mt.isMax()) {
+            futex(&m_seq, FUTEX_WAIT_PRIVATE, seq);
+        } else {
+            // FUTEX_WAIT_BITSET takes an absolute CLOCK_MONOTONIC time
+            struct timespec abstime = Clock::toSystem(mt);
+            if (futex(&m_seq, FUTEX_WAIT_BITSET_PRIVATE, seq, &abstime) != 0 
+                && errno == ETIMEDOUT)
+                rc = ETIMEDOUT;
+        }
+        fetchAndSub(&m_waiters, 1);
+        mutex.lock();
+        return rc;
+    }
+
+    void FastCondition::wake(int count)
+    {
+        fetchAndAdd(&m_seq, 1);
+        futex(&m_seq, FUTEX_WAKE_PRIVATE, count < 0 ? INT_MAX : count);
+    }
+
     Mutex::Mutex()
     {        
         ATE_ASSERT(pthread_mutexattr_init(&m_attr) == 0);
@@ -111,6 +316,9 @@ namespace ate {
     Condition::Condition()
     {        
         ATE_ASSERT(pthread_condattr_init(&m_condattr) == 0);
+        // timed waits do not jump with the wall clock
+        ATE_ASSERT(pthread_condattr_setclock(&m_condattr, 
+                                             CLOCK_MONOTONIC) == 0);
         ATE_ASSERT(pthread_cond_init(&m_cond, &m_condattr) == 0);
     }
     
@@ -0,0 +1,63 @@
+#include <ate/ate.hpp>
+
+#include <map>
+#include <functional>
+
+using namespace std;
+using namespace ate;
+
+namespace {
+    const int keys = 100000;
+    const int rounds = 20;
+
+    template <typename Map>
+    void benchmarkMap(const char* name)
+    {
+        Map m;
+        MicroTime start = MicroTime::now();
+        for (int r = 0; r < rounds; ++r) {
+            for (int i = 0; i < keys; ++i)
+                m.insert(make_pair((i * 7919) % keys, i));
+            for (int i = 0; i < keys; ++i)
+                m.erase(i);
+        }
+        MicroTime end = MicroTime::now();
+        ATE_ASSERT(m.empty());
+        double nanos = (end.microsec - start.microsec) * 1000.0 / 
+            (2.0 * rounds * keys);
+        cout << name << " insert/erase: " << nanos << " ns" << endl;
+    }
+
+    void testArena()
+    {
+        Bin bin;
+        typedef vector<char*, BinAllocator<char*> > Tokens;
+        char line[] = "  AAPL 100 @ 172.50  ";
+        for (int i = 0; i < 1000; ++i) {
+            BinScope scope(bin); // the vector memory is dropped per request
+            Tokens tokens((BinAllocator<char*>(bin)));
+            char buf[sizeof(line)];
+            memcpy(buf, line, sizeof(line));
+            tokenize(tokens, buf);
+            ATE_ASSERT(tokens.size() == 4);
+            ATE_ASSERT(strcmp(tokens[0], "AAPL") == 0);
+            ATE_ASSERT(strcmp(tokens[3], "172.50") == 0);
+        }
+        typedef map<int, int, less<int>, 
+            BinAllocator<pair<const int, int> > > ArenaMap;
+        BinScope scope(bin);
+        less<int> cmp;
+        ArenaMap m(cmp, BinAllocator<pair<const int, int> >(bin));
+        for (int i = 0; i < 1000; ++i)
+            m[i] = i;
+        ATE_ASSERT(m.size() == 1000 && m[999] == 999);
+    }
+}
+
+int main()
+{
+    testArena();
+    benchmarkMap<map<int, int> >("std::allocator");
+    benchmarkMap<map<int, int, less<int>, 
+        PoolAllocator<pair<const int, int> > > >("PoolAllocator");
+}
@@ -0,0 +1,231 @@
+#include <ate/ate.hpp>
+
+using namespace std;
+using namespace ate;
+
+namespace {
+    const int loops = 10000000;
+    const int threadMax = 4;
+
+    struct Shared {
+        volatile int i;
+        char pad1[CACHE_LINE_SIZE];
+        volatile long l;
+        char pad2[CACHE_LINE_SIZE];
+        volatile uint64_t q;
+        char pad3[CACHE_LINE_SIZE];
+        void* volatile p;
+        char pad4[CACHE_LINE_SIZE];
+        volatile TaggedPtr t;
+    };
+
+    Shared shared;
+
+    // every operation is run in the inline assembly and the builtin version
+    struct FetchAndAdd {
+        static const char* name() { return "FetchAndAdd"; }
+        static void runAsm(int) {
+            fetchAndAdd(&shared.l, 1L);
+        }
+        static void runBuiltin(int) {
+            builtin::fetchAndAdd(&shared.l, 1L);
+        }
+    };
+
+    struct Exchange {
+        static const char* name() { return "Exchange"; }
+        static void runAsm(int n) {
+            exchange(&shared.i, n);
+        }
+        static void runBuiltin(int n) {
+            builtin::exchange(&shared.i, n);
+        }
+    };
+
+    struct CmpAndSwap {
+        static const char* name() { return "CmpAndSwap"; }
+        static void runAsm(int n) {
+            cmpAndSwap(&shared.i, shared.i, n);
+        }
+        static void runBuiltin(int n) {
+            builtin::cmpAndSwap(&shared.i, shared.i, n);
+        }
+    };
+
+    struct CmpAndSwap64 {
+        static const char* name() { return "CmpAndSwap64"; }
+        static void runAsm(int n) {
+            cmpAndSwap64(&shared.q, shared.q, n);
+        }
+        static void runBuiltin(int n) {
+            builtin::cmpAndSwap64(&shared.q, shared.q, n);
+        }
+    };
+
+    struct CmpAndSwapPtr {
+        static const char* name() { return "CmpAndSwapPtr"; }
+        static void runAsm(int n) {
+            cmpAndSwapPtr(&shared.p, shared.p, &shared.pad4[n & 63]);
+        }
+        static void runBuiltin(int n) {
+            builtin::cmpAndSwapPtr(&shared.p, shared.p, &shared.pad4[n & 63]);
+        }
+    };
+
+    struct FetchAndStorePtr {
+        static const char* name() { return "FetchAndStorePtr"; }
+        static void runAsm(int n) {
+            fetchAndStorePtr(&shared.p, &shared.pad4[n & 63]);
+        }
+        static void runBuiltin(int n) {
+            builtin::fetchAndStorePtr(&shared.p, &shared.pad4[n & 63]);
+        }
+    };
+
+    struct AcquireFence {
+        static const char* name() { return "AcquireFence"; }
+        static void runAsm(int n) {
+            shared.i = n;
+            acquireFence();
+        }
+        static void runBuiltin(int n) {
+            shared.i = n;
+            builtin::acquireFence();
+        }
+    };
+
+    struct ReleaseFence {
+        static const char* name() { return "ReleaseFence"; }
+        static void runAsm(int n) {
+            shared.i = n;
+            releaseFence();
+        }
+        static void runBuiltin(int n) {
+            shared.i = n;
+            builtin::releaseFence();
+        }
+    };
+
+    struct SeqFence {
+        static const char* name() { return "SeqFence"; }
+        static void runAsm(int n) {
+            shared.i = n;
+            seqFence();
+        }
+        static void runBuiltin(int n) {
+            shared.i = n;
+            builtin::seqFence();
+        }
+    };
+
+    struct Membar {
+        static const char* name() { return "Membar"; }
+        static void runAsm(int n) {
+            shared.i = n;
+            membar();
+        }
+        static void runBuiltin(int n) {
+            shared.i = n;
+            builtin::membar();
+        }
+    };
+
+    struct CmpAndSwap2 {
+        static const char* name() { return "CmpAndSwap2"; }
+        static void runAsm(int n) {
+            TaggedPtr cmp = { shared.t.ptr, shared.t.tag };
+            TaggedPtr val = { &shared.pad4[n & 63], cmp.tag + 1 };
+            cmpAndSwap2(&shared.t, cmp, val);
+        }
+        static void runBuiltin(int n) {
+            TaggedPtr cmp = { shared.t.ptr, shared.t.tag };
+            TaggedPtr val = { &shared.pad4[n & 63], cmp.tag + 1 };
+            builtin::cmpAndSwap2(&shared.t, cmp, val);
+        }
+    };
+
+    template <typename Op>
+    class Worker : public Thread {
+    public:
+        Worker(bool useAsm, pthread_barrier_t* barrier) 
+            : Thread(true), m_asm(useAsm), m_barrier(barrier) {}
+        void run() {
+            pthread_barrier_wait(m_barrier);
+            if (m_asm) {
+                for (int n = 0; n < loops; ++n)
+                    Op::runAsm(n);
+            } else {
+                for (int n = 0; n < loops; ++n)
+                    Op::runBuiltin(n);
+            }
+        }
+    private:
+        bool m_asm;
+        pthread_barrier_t* m_barrier;
+    };
+
+    // nanoseconds per operation with nThreads on the same cache line
+    template <typename Op>
+    double measure(bool useAsm, int nThreads)
+    {
+        Worker<Op>* workers[threadMax];
+        pthread_barrier_t barrier;
+        ATE_ASSERT(pthread_barrier_init(&barrier, NULL, nThreads) == 0);
+        for (int i = 0; i < nThreads; ++i)
+            workers[i] = new Worker<Op>(useAsm, &barrier);
+        MicroTime start = MicroTime::now();
+        for (int i = 0; i < nThreads; ++i)
+            workers[i]->start();
+        for (int i = 0; i < nThreads; ++i)
+            workers[i]->join();
+        MicroTime end = MicroTime::now();
+        pthread_barrier_destroy(&barrier);
+        for (int i = 0; i < nThreads; ++i)
+            delete workers[i];
+        return (end.microsec - start.microsec) * 1000.0 / loops;
+    }
+
+    template <typename Op>
+    void benchmark()
+    {
+        for (int n = 1; n <= threadMax; n *= threadMax) {
+            cout << Op::name() << " threads: " << n 
+                 << " asm: " << measure<Op>(true, n) << " ns"
+                 << " builtin: " << measure<Op>(false, n) << " ns" << endl;
+        }
+    }
+
+    void testSemantics()
+    {
+        volatile int i = 5;
+        ATE_ASSERT(fetchAndAdd(&i, 3) == 5 && i == 8);
+        ATE_ASSERT(fetchAndSub(&i, 2) == 8 && i == 6);
+        ATE_ASSERT(exchange(&i, 1) == 6 && i == 1);
+        volatile long l = 5;
+        ATE_ASSERT(fetchAndAdd(&l, 3L) == 5 && l == 8);
+        ATE_ASSERT(fetchAndSub(&l, 2L) == 8 && l == 6);
+        ATE_ASSERT(exchange(&l, 1L) == 6 && l == 1);
+        volatile uint64_t q = ((uint64_t)1 << 40);
+        ATE_ASSERT(cmpAndSwap64(&q, 1, 2) == ((uint64_t)1 << 40));
+        ATE_ASSERT(cmpAndSwap64(&q, q, 3) == ((uint64_t)1 << 40) && q == 3);
+        ATE_ASSERT(builtin::cmpAndSwap64(&q, 3, 4) == 3 && q == 4);
+        ATE_ASSERT(builtin::fetchAndAdd(&i, 1) == 1 && i == 2);
+        cout << "atomic test OK" << endl;
+    }
+}
+
+int main()
+{
+    testSemantics();
+    benchmark<FetchAndAdd>();
+    benchmark<Exchange>();
+    benchmark<CmpAndSwap>();
+    benchmark<CmpAndSwap64>();
+    benchmark<CmpAndSwapPtr>();
+    benchmark<FetchAndStorePtr>();
+    benchmark<CmpAndSwap2>();
+    benchmark<AcquireFence>();
+    benchmark<ReleaseFence>();
+    benchmark<SeqFence>();
+    benchmark<Membar>();
+}
@@ -0,0 +1,119 @@
+#include <ate/ate.hpp>
+
+using namespace std;
+using namespace ate;
+
+namespace {
+    struct Payload {
+        int type;
+        int len;
+        char data[48];
+    };
+
+    const int threadMax = 8;
+    const int batch = 1024;
+    const int rounds = 2000;
+
+    struct MallocAlloc {
+        const char* name() { return "malloc"; }
+        Payload* alloc() { return static_cast<Payload*>(::malloc(sizeof(Payload))); }
+        void dealloc(Payload* p) { ::free(p); }
+    };
+
+    struct MutexPoolAlloc {
+        const char* name() { return "Pool + Mutex"; }
+        Payload* alloc() {
+            LockGuard<Mutex> guard(mutex);
+            return pool.alloc();
+        }
+        void dealloc(Payload* p) {
+            LockGuard<Mutex> guard(mutex);
+            pool.dealloc(p);
+        }
+        Mutex mutex;
+        Pool<Payload> pool;
+    };
+
+    struct CachedPoolAlloc {
+        const char* name() { return "CachedPool"; }
+        Payload* alloc() { return pool.alloc(); }
+        void dealloc(Payload* p) { pool.dealloc(p); }
+        CachedPool<Payload> pool;
+    };
+
+    // each thread fills its own slots, then frees the slots of its neighbour
+    // so that every object is released by a thread other than its allocator
+    template <typename Alloc>
+    class Worker : public Thread {
+    public:
+        Worker() : Thread(true) {}
+        void init(Alloc* alloc, Payload** slots, Payload** peer,
+                  pthread_barrier_t* barrier) {
+            m_alloc = alloc;
+            m_slots = slots;
+            m_peer = peer;
+            m_barrier = barrier;
+        }
+        void run() {
+            for (int r = 0; r < rounds; ++r) {
+                for (int i = 0; i < batch; ++i) {
+                    m_slots[i] = m_alloc->alloc();
+                    m_slots[i]->type = i;
+                }
+                pthread_barrier_wait(m_barrier);
+                for (int i = 0; i < batch; ++i) {
+                    ATE_ASSERT(m_peer[i]->type == i);
+                    m_alloc->dealloc(m_peer[i]);
+                }
+                pthread_barrier_wait(m_barrier);
+            }
+        }
+    private:
+        Alloc* m_alloc;
+        Payload** m_slots;
+        Payload** m_peer;
+        pthread_barrier_t* m_barrier;
+    };
+
+    template <typename Alloc>
+    void benchmark(int nThreads)
+    {
+        Alloc alloc;
+        static Payload* slots[threadMax][batch];
+        Worker<Alloc>* workers[threadMax];
+        pthread_barrier_t barrier;
+        ATE_ASSERT(pthread_barrier_init(&barrier, NULL, nThreads) == 0);
+        for (int i = 0; i < nThreads; ++i) {
+            workers[i] = new Worker<Alloc>();
+            workers[i]->init(&alloc, slots[i], slots[(i + 1) % nThreads],
+                             &barrier);
+        }
+        MicroTime start = MicroTime::now();
+        for (int i = 0; i < nThreads; ++i)
+            workers[i]->start();
+        for (int i = 0; i < nThreads; ++i)
+            workers[i]->join();
+        MicroTime end = MicroTime::now();
+        pthread_barrier_destroy(&barrier);
+        for (int i = 0; i < nThreads; ++i)
+            delete workers[i];
+        uint64_t ops = (uint64_t)nThreads * rounds * batch;
+        double nanos = (end.microsec - start.microsec) * 1000.0 / ops;
+        cout << alloc.name() << " threads: " << nThreads
+             << " alloc+dealloc: " << nanos << " ns" << endl;
+    }
+
+    template <typename Alloc>
+    void benchmarkAll()
+    {
+        for (int n = 1; n <= threadMax; n *= 2)
+            benchmark<Alloc>(n);
+    }
+}
+
+int main()
+{
+    benchmarkAll<MallocAlloc>();
+    benchmarkAll<MutexPoolAlloc>();
+    benchmarkAll<CachedPoolAlloc>();
+}
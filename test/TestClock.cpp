@@ -0,0 +1,133 @@
+#include <ate/ate.hpp>
+#include <time.h>
+
+using namespace std;
+using namespace ate;
+
+namespace {
+    const int loops = 10000000;
+
+    struct WallNow {
+        static const char* name() { return "NanoTime::now()"; }
+        static uint64_t get() { return NanoTime::now().nanosec; }
+    };
+
+    struct MonotonicNow {
+        static const char* name() { return "NanoTime::monotonic()"; }
+        static uint64_t get() { return NanoTime::monotonic().nanosec; }
+    };
+
+    struct CachedNow {
+        static const char* name() { return "NanoTime::cached()"; }
+        static uint64_t get() { return NanoTime::cached().nanosec; }
+    };
+
+    struct MicroNow {
+        static const char* name() { return "MicroTime::now()"; }
+        static uint64_t get() { return MicroTime::now().microsec; }
+    };
+
+    struct ClockGettime {
+        static const char* name() { return "clock_gettime(CLOCK_MONOTONIC)"; }
+        static uint64_t get() { 
+            timespec ts;
+            clock_gettime(CLOCK_MONOTONIC, &ts);
+            return ts.tv_nsec;
+        }
+    };
+
+    struct Rdtsc {
+        static const char* name() { return "getClockTicks()"; }
+        static uint64_t get() { return getClockTicks(); }
+    };
+
+    template <typename Now>
+    void benchmark()
+    {
+        uint64_t sum = 0;
+        NanoTime start = NanoTime::monotonic();
+        for (int i = 0; i < loops; ++i)
+            sum += Now::get();
+        NanoTime end = NanoTime::monotonic();
+        cout << Now::name() << ": " 
+             << (double)(end.nanosec - start.nanosec) / loops << " ns" 
+             << (sum == 0 ? " " : "") << endl;
+    }
+
+    void testClock()
+    {
+        cout << "tsc: " << Clock::tsc() << " ticks/sec: " 
+             << Clock::ticksPerSecond() << endl;
+        // wall time agrees with gettimeofday()
+        for (int i = 0; i < 3; ++i) {
+            MicroTime micro = MicroTime::now();
+            NanoTime nano = NanoTime::now();
+            int64_t diff = (int64_t)nano.toMicroTime().microsec - 
+                (int64_t)micro.microsec;
+            cout << "wall " << nano << " gettimeofday " << micro 
+                 << " diff: " << diff << " us" << endl;
+            ATE_ASSERT(diff > -1000 && diff < 1000);
+            Thread::sleep(500);
+        }
+        // monotonic never goes back, also across resyncs
+        NanoTime start = NanoTime::monotonic();
+        NanoTime last = start;
+        while (last.nanosec - start.nanosec < 1500000000) {
+            NanoTime now = NanoTime::monotonic();
+            ATE_ASSERT(now >= last);
+            last = now;
+        }
+        // and stays with CLOCK_MONOTONIC
+        timespec ts;
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+        int64_t drift = (int64_t)NanoTime::monotonic().nanosec - 
+            ((int64_t)ts.tv_sec * 1000000000 + ts.tv_nsec);
+        cout << "drift from CLOCK_MONOTONIC: " << drift << " ns" << endl;
+        ATE_ASSERT(drift > -1000000 && drift < 1000000);
+        NanoTime cached = Clock::update();
+        ATE_ASSERT(NanoTime::cached() == cached && cached >= last);
+        NanoTime wall = Clock::toWall(cached);
+        ATE_ASSERT(wall.nanosec / 1000 + 1000 > MicroTime::now().microsec);
+        cout << "clock test OK" << endl;
+    }
+
+    // how late a 200 us timed wait returns
+    void testTimedWait(unsigned long slack)
+    {
+        const int waits = 1000;
+        Thread::setTimerSlack(slack);
+        // deadlines are handed to the kernel on its own clock
+        timespec ts;
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+        timespec system = Clock::toSystem(MicroTime::monotonic());
+        int64_t diff = (int64_t)(system.tv_sec - ts.tv_sec) * 1000000000 + 
+            system.tv_nsec - ts.tv_nsec;
+        ATE_ASSERT(diff > -1000 && diff < 100000);
+        Monitor monitor;
+        LockGuard<Monitor> guard(monitor);
+        uint64_t late = 0;
+        for (int i = 0; i < waits; ++i) {
+            MicroTime deadline = MicroTime::monotonic();
+            deadline.microsec += 200;
+            ATE_ASSERT(monitor.timedWait(deadline) == ETIMEDOUT);
+            MicroTime now = MicroTime::monotonic();
+            ATE_ASSERT(now >= deadline);
+            late += now.microsec - deadline.microsec;
+        }
+        cout << "200 us timed wait, timer slack " << slack << " ns, late: "
+             << (double)late / waits << " us" << endl;
+    }
+}
+
+int main()
+{
+    testClock();
+    testTimedWait(50000);
+    testTimedWait(1000);
+    benchmark<WallNow>();
+    benchmark<MonotonicNow>();
+    benchmark<CachedNow>();
+    benchmark<MicroNow>();
+    benchmark<ClockGettime>();
+    benchmark<Rdtsc>();
+}
@@ -0,0 +1,66 @@
+#include <ate/ate.hpp>
+
+using namespace std;
+using namespace ate;
+
+namespace {
+    struct EventNode {
+        volatile int owner;
+        int seq;
+        char payload[56];
+    };
+
+    const int threadMax = 8;
+    const int batch = 64;
+    const int rounds = 100000;
+
+    ConcurrentPool<EventNode>* pool;
+
+    class Worker : public Thread {
+    public:
+        Worker(int id) : Thread(true), m_id(id) {}
+        void run() {
+            EventNode* nodes[batch];
+            for (int r = 0; r < rounds; ++r) {
+                for (int i = 0; i < batch; ++i) {
+                    nodes[i] = pool->alloc();
+                    nodes[i]->owner = m_id;
+                    nodes[i]->seq = i;
+                }
+                // a block handed out twice would be overwritten by now
+                for (int i = 0; i < batch; ++i) {
+                    ATE_ASSERT(nodes[i]->owner == m_id && nodes[i]->seq == i);
+                    pool->dealloc(nodes[i]);
+                }
+            }
+        }
+    private:
+        int m_id;
+    };
+
+    void stress(int nThreads)
+    {
+        ConcurrentPool<EventNode> p("EventNodePool", 16, 1024);
+        pool = &p;
+        Worker* workers[threadMax];
+        for (int i = 0; i < nThreads; ++i) 
+            workers[i] = new Worker(i);
+        MicroTime start = MicroTime::now();
+        for (int i = 0; i < nThreads; ++i)
+            workers[i]->start();
+        for (int i = 0; i < nThreads; ++i) {
+            workers[i]->join();
+            delete workers[i];
+        }
+        MicroTime end = MicroTime::now();
+        double ops = (double)nThreads * rounds * batch;
+        cout << "threads: " << nThreads << " alloc+dealloc: " 
+             << ops / (end.microsec - start.microsec) << " M/s" << endl;
+    }
+}
+
+int main()
+{
+    for (int n = 1; n <= threadMax; n *= 2)
+        stress(n);
+}
@@ -0,0 +1,95 @@
+#include <ate/ate.hpp>
+
+using namespace std;
+using namespace ate;
+
+namespace {
+    const int burst = 100000;
+    const int messageSize = 512; // checksummed in about 1 us
+    char message[messageSize];
+
+    uint32_t fnv1a(const void* data, int len)
+    {
+        const unsigned char* p = static_cast<const unsigned char*>(data);
+        uint32_t hash = 2166136261U;
+        for (int i = 0; i < len; ++i)
+            hash = (hash ^ p[i]) * 16777619U;
+        return hash;
+    }
+
+    bool stopLoop(const Timer& timer)
+    {
+        static_cast<EventLoop*>(timer.aux)->setRunning(false);
+        return true;
+    }
+
+    // checksums each message, stops the loop after the due timers once 
+    // the burst is handled
+    class ChecksumHandler : public EventHandler {
+    public:
+        ChecksumHandler(EventLoop& evloop)
+            : m_evloop(evloop), m_count(0), m_checksum(0) {}
+        virtual void onEvent(Event& event) {
+            ATE_ASSERT(event.len == m_count);
+            m_checksum += fnv1a(event.data, messageSize);
+            if (++m_count == burst) {
+                Timer timer;
+                timer.time = MicroTime::monotonic();
+                timer.increment = -1;
+                timer.tcb = stopLoop;
+                timer.aux = &m_evloop;
+                m_evloop.addTimer(timer);
+            }
+        }
+        uint32_t checksum() const { return m_checksum; }
+    private:
+        EventLoop& m_evloop;
+        int m_count;
+        uint32_t m_checksum;
+    };
+
+    bool tick(const Timer&)
+    {
+        return false; // recurring
+    }
+
+    // a 1 ms timer runs while one batch of 100k events is handled
+    void benchmark(size_t maxEvents, int maxMicros)
+    {
+        EventLoop evloop;
+        evloop.setDispatchLimits(maxEvents, maxMicros);
+        ChecksumHandler handler(evloop);
+        vector<Event> events;
+        for (int i = 0; i < burst; ++i)
+            events.push_back(Event(0, i, message, &handler));
+        Timer timer;
+        timer.time = MicroTime::monotonic().add(1);
+        timer.increment = 1;
+        timer.tcb = tick;
+        timer.aux = NULL;
+        evloop.addTimer(timer);
+        evloop.pushN(events.begin(), events.end());
+        NanoTime start = NanoTime::monotonic();
+        evloop.run();
+        NanoTime end = NanoTime::monotonic();
+        ATE_ASSERT(handler.checksum() == fnv1a(message, messageSize) * burst);
+        const TimerQueue::Stats& stats = evloop.timerStats();
+        cout << "maxEvents: " << maxEvents << " maxMicros: " << maxMicros
+             << " burst ms: " << (end.nanosec - start.nanosec) / 1000000
+             << " capped cycles: " << evloop.cappedCycles()
+             << " timer fired: " << stats.fired
+             << " avg late us: "
+             << (stats.fired != 0 ? stats.lateMicros / stats.fired : 0)
+             << " max late us: " << stats.maxLateMicros << endl;
+    }
+}
+
+int main()
+{
+    for (int i = 0; i < messageSize; ++i)
+        message[i] = (char)i;
+    benchmark(0, 0); // one stop-the-world batch
+    benchmark(256, 0);
+    benchmark(0, 200);
+    benchmark(1024, 200);
+}
@@ -0,0 +1,138 @@
+#include <ate/ate.hpp>
+#include <unistd.h>
+
+using namespace std;
+using namespace ate;
+
+namespace {
+    const int keyCount = 1024;
+    const int eventCount = 400000;
+    const int workLoops = 200; // about 1 us of handler work
+    const size_t loopMax = 8;
+
+    // the per key state after event seq
+    uint32_t update(uint32_t state, int seq)
+    {
+        for (int i = 0; i < workLoops; ++i)
+            state = state * 31 + seq + i;
+        return state;
+    }
+
+    // checks the order per key; a key is only handled by its own loop, 
+    // so its state needs no lock
+    class KeyHandler : public EventHandler {
+    public:
+        KeyHandler() : m_done(0) {
+            for (int i = 0; i < keyCount; ++i) {
+                m_next[i] = 0;
+                m_state[i] = 0;
+            }
+        }
+        virtual void onEvent(Event& event) {
+            ATE_ASSERT(event.len == m_next[event.type]);
+            ++m_next[event.type];
+            m_state[event.type] = update(m_state[event.type], event.len);
+            fetchAndAdd(&m_done, 1);
+        }
+        int done() const { return m_done; }
+        uint32_t state(int key) const { return m_state[key]; }
+    private:
+        volatile int m_done;
+        int m_next[keyCount];
+        uint32_t m_state[keyCount];
+    };
+
+    class ExitHandler : public EventHandler {
+    public:
+        ExitHandler(EventLoop& evloop) : m_evloop(evloop), m_count(0) {}
+        virtual void onEvent(Event& event) {
+            if (event.type == 1)
+                m_evloop.setRunning(false);
+            else
+                fetchAndAdd(&m_count, 1);
+        }
+        int count() const { return m_count; }
+    private:
+        EventLoop& m_evloop;
+        volatile int m_count;
+    };
+
+    // a loop that exits on its own does not stop right after a restart
+    void testSelfExit()
+    {
+        EventLoopGroup group(2);
+        ExitHandler handler(group.loop(0));
+        group.start();
+        group.push(0, Event(1, 0, NULL, &handler));
+        while (group.loop(0).isRunning())
+            Thread::sleep(1);
+        group.stop();
+        group.start();
+        group.push(0, Event(0, 0, NULL, &handler));
+        for (int i = 0; i < 1000 && handler.count() == 0; ++i)
+            Thread::sleep(1);
+        ATE_ASSERT(handler.count() == 1 && group.loop(0).isRunning());
+        group.stop();
+        cout << "self exit test OK" << endl;
+    }
+
+    void testRouting()
+    {
+        EventLoopGroup group(4);
+        size_t counts[4] = {0, 0, 0, 0};
+        for (uint64_t key = 0; key < 4000; ++key) {
+            size_t i = group.route(key);
+            ATE_ASSERT(i < group.size() && i == group.route(key));
+            ++counts[i];
+        }
+        for (size_t i = 0; i < 4; ++i) // spread evenly
+            ATE_ASSERT(counts[i] > 800 && counts[i] < 1200);
+        group.start();
+        group.stop();
+        group.start(); // can start again
+        group.stop();
+        cout << "routing test OK" << endl;
+    }
+
+    void benchmark(size_t nLoops)
+    {
+        vector<int> cpus;
+        long ncpu = sysconf(_SC_NPROCESSORS_ONLN);
+        for (long i = 0; i < ncpu; ++i)
+            cpus.push_back(i);
+        EventLoopGroup group(nLoops, cpus);
+        KeyHandler handler;
+        int seq[keyCount];
+        for (int i = 0; i < keyCount; ++i)
+            seq[i] = 0;
+        group.start();
+        NanoTime start = NanoTime::monotonic();
+        for (int i = 0; i < eventCount; ++i) {
+            int key = i * 7 % keyCount;
+            group.pushByKey(key, Event(key, seq[key]++, NULL, &handler));
+        }
+        while (handler.done() < eventCount)
+            Thread::sleep(1);
+        NanoTime end = NanoTime::monotonic();
+        group.stop();
+        vector<uint32_t> states(keyCount, 0);
+        vector<int> next(keyCount, 0);
+        for (int i = 0; i < eventCount; ++i) {
+            int key = i * 7 % keyCount;
+            states[key] = update(states[key], next[key]++);
+        }
+        for (int i = 0; i < keyCount; ++i)
+            ATE_ASSERT(handler.state(i) == states[i]);
+        double seconds = (end.nanosec - start.nanosec) / 1e9;
+        cout << "EventLoopGroup loops: " << nLoops << " cpus: " << ncpu
+             << " events/sec: " << (uint64_t)(eventCount / seconds) << endl;
+    }
+}
+
+int main()
+{
+    testRouting();
+    testSelfExit();
+    for (size_t n = 1; n <= loopMax; n *= 2)
+        benchmark(n);
+}
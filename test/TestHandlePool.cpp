@@ -0,0 +1,148 @@
+#include <ate/ate.hpp>
+
+using namespace std;
+using namespace ate;
+
+namespace {
+    struct PtrNode {
+        PtrNode* next;
+        int value;
+    };
+
+    struct HandleNode {
+        HandlePool<HandleNode>::Handle next;
+        int value;
+    };
+
+    const size_t nodeCount = 1 << 20;
+    const int chases = 20;
+
+    void testHandles()
+    {
+        HandlePool<HandleNode> pool("HandleNodes", 1000, 64);
+        HandlePool<HandleNode>::Handle a = pool.alloc();
+        ATE_ASSERT(a != HandlePool<HandleNode>::NULL_HANDLE);
+        ATE_ASSERT(pool.get(a) != NULL);
+        ATE_ASSERT(pool.handleOf(pool.get(a)) == a);
+        ATE_ASSERT(pool.live(a & HandlePool<HandleNode>::INDEX_MASK));
+        pool.dealloc(a);
+        ATE_ASSERT(pool.get(a) == NULL);
+        // free slots are reused FIFO
+        HandlePool<HandleNode>::Handle b = pool.alloc();
+        ATE_ASSERT(b != a && pool.get(b) != pool[a]);
+        pool.dealloc(b);
+        ATE_ASSERT(pool.get(HandlePool<HandleNode>::NULL_HANDLE) == NULL);
+
+        // a stale handle stays stale for 2^(31 - INDEX_BITS) reuses of its 
+        // slot, and generations wrap without ever producing a null handle
+        const int maxReuses = 1 << (31 - HandlePool<HandleNode>::INDEX_BITS);
+        for (int reuses = 0; reuses < maxReuses; ) {
+            HandlePool<HandleNode>::Handle h = pool.alloc();
+            ATE_ASSERT(h != HandlePool<HandleNode>::NULL_HANDLE);
+            if (pool[h] == pool[a])
+                ++reuses;
+            ATE_ASSERT(reuses == maxReuses || pool.get(a) == NULL);
+            pool.dealloc(h);
+        }
+
+        // fewer index bits leave more for the generation
+        HandlePool<HandleNode, 16> wide("WideNodes", 16, 16);
+        HandlePool<HandleNode, 16>::Handle old = wide.alloc();
+        wide.dealloc(old);
+        for (int i = 0; i < 100000; ++i) {
+            wide.dealloc(wide.alloc());
+            ATE_ASSERT(wide.get(old) == NULL);
+        }
+
+        // grows up to maxSlots without moving objects
+        vector<HandlePool<HandleNode>::Handle> handles;
+        HandleNode* first = NULL;
+        for (int i = 0; i < 1000; ++i) {
+            handles.push_back(pool.alloc());
+            pool[handles.back()]->value = i;
+            if (i == 0)
+                first = pool[handles.back()];
+        }
+        ATE_ASSERT(pool.capacity() == 1000);
+        ATE_ASSERT(pool[handles[0]] == first);
+        ATE_ASSERT(pool.stats().inUse == 1000);
+        size_t live = 0;
+        for (size_t i = 0; i < pool.capacity(); ++i) {
+            if (pool.live(i))
+                ++live;
+        }
+        ATE_ASSERT(live == 1000);
+        for (int i = 0; i < 1000; ++i) {
+            ATE_ASSERT(pool[handles[i]]->value == i);
+            pool.dealloc(handles[i]);
+        }
+        ATE_ASSERT(pool.stats().inUse == 0);
+        cout << "handle test OK" << endl;
+    }
+
+    // link the nodes into one random cycle
+    template <typename Link>
+    void shuffle(vector<Link>& links)
+    {
+        srand(1);
+        for (size_t i = links.size() - 1; i > 0; --i)
+            swap(links[i], links[rand() % (i + 1)]);
+    }
+
+    void benchmark()
+    {
+        Pool<PtrNode> ptrPool("PtrNodes");
+        vector<PtrNode*> ptrs;
+        for (size_t i = 0; i < nodeCount; ++i)
+            ptrs.push_back(ptrPool.alloc());
+        shuffle(ptrs);
+        for (size_t i = 0; i < nodeCount; ++i) {
+            ptrs[i]->next = ptrs[(i + 1) % nodeCount];
+            ptrs[i]->value = i;
+        }
+
+        HandlePool<HandleNode> handlePool("HandleNodes", nodeCount, 1 << 16);
+        vector<HandlePool<HandleNode>::Handle> handles;
+        for (size_t i = 0; i < nodeCount; ++i)
+            handles.push_back(handlePool.alloc());
+        shuffle(handles);
+        for (size_t i = 0; i < nodeCount; ++i) {
+            handlePool[handles[i]]->next = handles[(i + 1) % nodeCount];
+            handlePool[handles[i]]->value = i;
+        }
+
+        long sum = 0;
+        MicroTime start = MicroTime::now();
+        for (int c = 0; c < chases; ++c) {
+            PtrNode* node = ptrs[0];
+            for (size_t i = 0; i < nodeCount; ++i) {
+                sum += node->value;
+                node = node->next;
+            }
+        }
+        MicroTime mid = MicroTime::now();
+        for (int c = 0; c < chases; ++c) {
+            HandlePool<HandleNode>::Handle h = handles[0];
+            for (size_t i = 0; i < nodeCount; ++i) {
+                HandleNode* node = handlePool.get(h); // checked
+                sum -= node->value;
+                h = node->next;
+            }
+        }
+        MicroTime end = MicroTime::now();
+        ATE_ASSERT(sum == 0);
+        double steps = (double)chases * nodeCount;
+        cout << "pointer chase: " << sizeof(PtrNode) << " byte nodes, "
+             << (mid.microsec - start.microsec) * 1000.0 / steps << " ns"
+             << endl;
+        cout << "handle chase: " << sizeof(HandleNode) << " byte nodes, "
+             << (end.microsec - mid.microsec) * 1000.0 / steps << " ns"
+             << endl;
+    }
+}
+
+int main()
+{
+    testHandles();
+    benchmark();
+}
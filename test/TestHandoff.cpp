@@ -0,0 +1,142 @@
+#include <ate/ate.hpp>
+
+using namespace std;
+using namespace ate;
+
+namespace {
+    const int eventCount = 20000;
+
+    // latency from push() to onEvent() in ticks
+    class LatencyHandler : public EventHandler {
+    public:
+        LatencyHandler() : m_handled(0) { m_latency.reserve(eventCount); }
+        virtual void onEvent(Event& event) {
+            m_latency.push_back(getClockTicks() - m_stamps[event.type]);
+            m_handled = event.type + 1;
+        }
+        void stamp(int i) { m_stamps[i] = getClockTicks(); }
+        int handled() const { return m_handled; }
+        vector<uint64_t>& latency() { return m_latency; }
+    private:
+        uint64_t m_stamps[eventCount];
+        vector<uint64_t> m_latency;
+        volatile int m_handled;
+    };
+
+    class Producer : public Thread {
+    public:
+        Producer(EventLoop& evloop, LatencyHandler& handler, bool wait)
+            : Thread(true), m_evloop(evloop), m_handler(handler), 
+              m_wait(wait) {}
+        void run() {
+            Event event;
+            event.handler = &m_handler;
+            for (int i = 0; i < eventCount; ++i) {
+                // let the loop park on the empty queue, or stream
+                if (m_wait) {
+                    while (m_handler.handled() != i)
+                        Thread::yield();
+                }
+                event.type = i;
+                m_handler.stamp(i);
+                m_evloop.push(event);
+            }
+            while (m_handler.handled() != eventCount)
+                Thread::yield();
+            m_evloop.setRunning(false);
+            m_evloop.push(event); // wake up the loop
+        }
+    private:
+        EventLoop& m_evloop;
+        LatencyHandler& m_handler;
+        bool m_wait;
+    };
+
+    void benchmark(bool wait)
+    {
+        EventLoop evloop;
+        LatencyHandler* handler = new LatencyHandler;
+        Producer producer(evloop, *handler, wait);
+        NanoTime start = NanoTime::monotonic();
+        producer.start();
+        evloop.run();
+        producer.join();
+        NanoTime end = NanoTime::monotonic();
+        if (wait) {
+            vector<uint64_t>& latency = handler->latency();
+            sort(latency.begin(), latency.end());
+            double nanosPerTick = 1e9 / Clock::ticksPerSecond();
+            cout << "parked consumer handoff p50: " 
+                 << latency[latency.size() / 2] * nanosPerTick << " ns p99: "
+                 << latency[latency.size() * 99 / 100] * nanosPerTick 
+                 << " ns" << endl;
+        } else {
+            cout << "streaming push to onEvent: " 
+                 << (double)(end.nanosec - start.nanosec) / eventCount 
+                 << " ns per event" << endl;
+        }
+        delete handler;
+    }
+
+    // two threads hand a token back and forth through one monitor
+    template <typename MonitorType>
+    class Ponger : public Thread {
+    public:
+        Ponger(MonitorType& monitor, volatile int& token) 
+            : Thread(true), m_monitor(monitor), m_token(token) {}
+        void run() {
+            LockGuard<MonitorType> guard(m_monitor);
+            for (int i = 0; i < eventCount; ++i) {
+                while (m_token != 1)
+                    m_monitor.wait();
+                m_token = 0;
+                m_monitor.notify();
+            }
+        }
+    private:
+        MonitorType& m_monitor;
+        volatile int& m_token;
+    };
+
+    template <typename MonitorType>
+    void pingPong(const char* name)
+    {
+        MonitorType monitor;
+        volatile int token = 0;
+        // no waiter: the cost on the push path
+        NanoTime start = NanoTime::monotonic();
+        for (int i = 0; i < eventCount * 100; ++i) {
+            LockGuard<MonitorType> guard(monitor);
+            monitor.notify();
+        }
+        NanoTime end = NanoTime::monotonic();
+        cout << name << " lock+notify+unlock: " 
+             << (double)(end.nanosec - start.nanosec) / (eventCount * 100)
+             << " ns" << endl;
+        Ponger<MonitorType> ponger(monitor, token);
+        start = NanoTime::monotonic();
+        ponger.start();
+        {
+            LockGuard<MonitorType> guard(monitor);
+            for (int i = 0; i < eventCount; ++i) {
+                token = 1;
+                monitor.notify();
+                while (token != 0)
+                    monitor.wait();
+            }
+        }
+        ponger.join();
+        end = NanoTime::monotonic();
+        cout << name << " round trip: " 
+             << (double)(end.nanosec - start.nanosec) / eventCount
+             << " ns" << endl;
+    }
+}
+
+int main()
+{
+    pingPong<PthreadMonitor>("PthreadMonitor");
+    pingPong<Monitor>("Monitor");
+    benchmark(true);
+    benchmark(false);
+}
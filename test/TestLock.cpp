@@ -0,0 +1,280 @@
+#include <ate/ate.hpp>
+
+using namespace std;
+using namespace ate;
+
+namespace {
+    const int threadMax = 16;
+    const unsigned int runMillis = 200;
+
+    struct Shared {
+        uint64_t counter;
+        char data[2 * CACHE_LINE_SIZE];
+    };
+
+    template <typename Lock>
+    struct LockName {
+        static const char* get();
+    };
+    template <> const char* LockName<SpinLock>::get() { return "SpinLock"; }
+    template <> const char* LockName<Mutex>::get() { return "Mutex"; }
+    template <> const char* LockName<FastMutex>::get() { return "FastMutex"; }
+    template <> const char* LockName<TicketLock>::get() { return "TicketLock"; }
+    template <> const char* LockName<McsLock>::get() { return "McsLock"; }
+
+    template <typename Lock>
+    class Worker : public Thread {
+    public:
+        Worker(Lock& lock, Shared& shared, volatile bool& stop,
+               pthread_barrier_t* barrier) 
+            : Thread(true), m_lock(lock), m_shared(shared), m_stop(stop),
+              m_barrier(barrier) {
+            m_latency.reserve(1 << 20);
+        }
+        void run() {
+            pthread_barrier_wait(m_barrier);
+            while (!m_stop) {
+                uint64_t start = getClockTicks();
+                LockGuard<Lock> guard(m_lock);
+                m_latency.push_back(getClockTicks() - start);
+                ++m_shared.counter;
+                m_shared.data[m_shared.counter % sizeof(m_shared.data)]++;
+            }
+        }
+        vector<uint64_t>& latency() { return m_latency; }
+    private:
+        Lock& m_lock;
+        Shared& m_shared;
+        volatile bool& m_stop;
+        pthread_barrier_t* m_barrier;
+        vector<uint64_t> m_latency; // acquire latency in ticks
+    };
+
+    template <typename Lock>
+    void benchmark(int nThreads)
+    {
+        Lock lock;
+        Shared shared;
+        memset(&shared, 0, sizeof(shared));
+        volatile bool stop = false;
+        Worker<Lock>* workers[threadMax];
+        pthread_barrier_t barrier;
+        ATE_ASSERT(pthread_barrier_init(&barrier, NULL, nThreads + 1) == 0);
+        for (int i = 0; i < nThreads; ++i) {
+            workers[i] = new Worker<Lock>(lock, shared, stop, &barrier);
+            workers[i]->start();
+        }
+        pthread_barrier_wait(&barrier);
+        Thread::sleep(runMillis);
+        stop = true;
+        vector<uint64_t> latency;
+        for (int i = 0; i < nThreads; ++i) {
+            workers[i]->join();
+            latency.insert(latency.end(), workers[i]->latency().begin(),
+                           workers[i]->latency().end());
+            delete workers[i];
+        }
+        pthread_barrier_destroy(&barrier);
+        ATE_ASSERT(shared.counter == latency.size());
+        sort(latency.begin(), latency.end());
+        double nanosPerTick = 1e9 / Clock::ticksPerSecond();
+        cout << LockName<Lock>::get() << " threads: " << nThreads
+             << " ops/sec: " << shared.counter * 1000 / runMillis
+             << " p50: " << latency[latency.size() / 2] * nanosPerTick 
+             << " ns p99: " << latency[latency.size() * 99 / 100] * nanosPerTick
+             << " ns max: " << latency.back() * nanosPerTick / 1000 << " us"
+             << endl;
+    }
+
+    template <typename Lock>
+    void benchmarkAll()
+    {
+        for (int n = 1; n <= threadMax; n *= 2)
+            benchmark<Lock>(n);
+    }
+
+    // reference data read by the event loops
+    struct Limits {
+        int instrument;
+        int maxOrders;
+        double maxNotional;
+        double maxPosition;
+        uint64_t version; // changes with every field
+    };
+
+    inline bool consistent(const Limits& limits)
+    {
+        return limits.instrument == (int)limits.version && 
+            limits.maxOrders == (int)limits.version * 2 &&
+            limits.maxNotional == limits.version * 1000.0 &&
+            limits.maxPosition == limits.version * 10.0;
+    }
+
+    inline void update(Limits& limits, uint64_t version)
+    {
+        limits.instrument = version;
+        limits.maxOrders = version * 2;
+        limits.maxNotional = version * 1000.0;
+        limits.maxPosition = version * 10.0;
+        limits.version = version;
+    }
+
+    // the same interface over the locks
+    template <typename Lock>
+    struct Published {
+        Limits read() {
+            LockGuard<Lock> guard(lock);
+            return limits;
+        }
+        void write(uint64_t version) {
+            LockGuard<Lock> guard(lock);
+            update(limits, version);
+        }
+        Lock lock;
+        Limits limits;
+    };
+
+    template <>
+    struct Published<RWSpinLock> {
+        Limits read() {
+            ReadGuard<RWSpinLock> guard(lock);
+            return limits;
+        }
+        void write(uint64_t version) {
+            LockGuard<RWSpinLock> guard(lock);
+            update(limits, version);
+        }
+        RWSpinLock lock;
+        Limits limits;
+    };
+
+    template <typename T>
+    struct Published<SeqLock<T> > {
+        Limits read() { return lock.load(); }
+        void write(uint64_t version) {
+            LockGuard<SeqLock<T> > guard(lock);
+            update(lock.value(), version);
+        }
+        SeqLock<T> lock;
+    };
+
+    template <typename Lock>
+    class Reader : public Thread {
+    public:
+        Reader(Published<Lock>& published, volatile bool& stop) 
+            : Thread(true), m_published(published), m_stop(stop), 
+              m_reads(0) {}
+        void run() {
+            while (!m_stop) {
+                Limits limits = m_published.read();
+                ATE_ASSERT(consistent(limits));
+                ++m_reads;
+            }
+        }
+        uint64_t reads() const { return m_reads; }
+    private:
+        Published<Lock>& m_published;
+        volatile bool& m_stop;
+        uint64_t m_reads;
+    };
+
+    template <typename Lock>
+    class Writer : public Thread {
+    public:
+        Writer(Published<Lock>& published, volatile bool& stop) 
+            : Thread(true), m_published(published), m_stop(stop) {}
+        void run() {
+            for (uint64_t version = 1; !m_stop; ++version) {
+                m_published.write(version);
+                Thread::sleep(1);
+            }
+        }
+    private:
+        Published<Lock>& m_published;
+        volatile bool& m_stop;
+    };
+
+    // readers against one writer that publishes every millisecond
+    template <typename Lock>
+    void readBenchmark(const char* name, int nReaders)
+    {
+        Published<Lock> published;
+        published.write(0);
+        volatile bool stop = false;
+        Reader<Lock>* readers[threadMax];
+        Writer<Lock> writer(published, stop);
+        for (int i = 0; i < nReaders; ++i) {
+            readers[i] = new Reader<Lock>(published, stop);
+            readers[i]->start();
+        }
+        writer.start();
+        Thread::sleep(runMillis);
+        stop = true;
+        writer.join();
+        uint64_t reads = 0;
+        for (int i = 0; i < nReaders; ++i) {
+            readers[i]->join();
+            reads += readers[i]->reads();
+            delete readers[i];
+        }
+        cout << name << " readers: " << nReaders 
+             << " reads/sec: " << reads * 1000 / runMillis << endl;
+    }
+
+    template <typename Lock>
+    void readBenchmarkAll(const char* name)
+    {
+        for (int n = 1; n <= threadMax / 2; n *= 2)
+            readBenchmark<Lock>(name, n);
+    }
+
+    void testLocks()
+    {
+        TicketLock ticket;
+        ATE_ASSERT(ticket.tryLock() && !ticket.tryLock());
+        ticket.unlock();
+        McsLock mcs1;
+        McsLock mcs2;
+        ATE_ASSERT(mcs1.tryLock() && !mcs1.tryLock());
+        {
+            LockGuard<McsLock> guard(mcs2); // nested
+            ATE_ASSERT(!mcs2.tryLock());
+        }
+        mcs1.unlock();
+        ATE_ASSERT(mcs2.tryLock());
+        mcs2.unlock();
+        RWSpinLock rw;
+        rw.readLock();
+        rw.readLock();
+        rw.readUnlock();
+        rw.readUnlock();
+        {
+            LockGuard<RWSpinLock> guard(rw);
+        }
+        {
+            ReadGuard<RWSpinLock> guard(rw);
+        }
+        Limits limits;
+        update(limits, 7);
+        SeqLock<Limits> seq(limits);
+        ATE_ASSERT(seq.load().version == 7);
+        update(limits, 8);
+        seq.store(limits);
+        ATE_ASSERT(consistent(seq.load()) && seq.load().version == 8);
+        cout << "lock test OK" << endl;
+    }
+}
+
+int main()
+{
+    testLocks();
+    benchmarkAll<SpinLock>();
+    benchmarkAll<Mutex>();
+    benchmarkAll<FastMutex>();
+    benchmarkAll<TicketLock>();
+    benchmarkAll<McsLock>();
+    readBenchmarkAll<Mutex>("Mutex");
+    readBenchmarkAll<SpinLock>("SpinLock");
+    readBenchmarkAll<RWSpinLock>("RWSpinLock");
+    readBenchmarkAll<SeqLock<Limits> >("SeqLock");
+}
@@ -0,0 +1,107 @@
+#include <ate/ate.hpp>
+
+using namespace std;
+using namespace ate;
+
+namespace {
+    const int producerMax = 16;
+    const int eventsPerProducer = 100000;
+    const int batchSize = 64;
+
+    // checks FIFO order per producer, stops the loop after the last event
+    template <typename Loop>
+    class CountingHandler : public EventHandler {
+    public:
+        CountingHandler(Loop& evloop, int expected) 
+            : m_evloop(evloop), m_expected(expected), m_count(0) {
+            for (int i = 0; i < producerMax; ++i)
+                m_next[i] = 0;
+        }
+        virtual void onEvent(Event& event) {
+            ATE_ASSERT(event.len == m_next[event.type]);
+            ++m_next[event.type];
+            if (++m_count == m_expected)
+                m_evloop.setRunning(false);
+        }
+    private:
+        Loop& m_evloop;
+        int m_expected;
+        int m_count;
+        int m_next[producerMax];
+    };
+
+    template <typename Loop>
+    class Producer : public Thread {
+    public:
+        Producer(Loop& evloop, EventHandler& handler, int id, 
+                 pthread_barrier_t* barrier, bool batch)
+            : Thread(true), m_evloop(evloop), m_handler(handler), m_id(id),
+              m_barrier(barrier), m_batch(batch) {}
+        void run() {
+            pthread_barrier_wait(m_barrier);
+            if (m_batch) {
+                Event events[batchSize];
+                for (int i = 0; i < eventsPerProducer; i += batchSize) {
+                    int n = min(batchSize, eventsPerProducer - i);
+                    for (int j = 0; j < n; ++j)
+                        events[j] = Event(m_id, i + j, NULL, &m_handler);
+                    m_evloop.pushN(events, events + n);
+                }
+            } else {
+                for (int i = 0; i < eventsPerProducer; ++i)
+                    m_evloop.emplace(m_id, i, NULL, &m_handler);
+            }
+        }
+    private:
+        Loop& m_evloop;
+        EventHandler& m_handler;
+        int m_id;
+        pthread_barrier_t* m_barrier;
+        bool m_batch;
+    };
+
+    template <typename Loop>
+    void benchmark(const char* name, int nProducers, bool batch)
+    {
+        Loop evloop;
+        CountingHandler<Loop> handler(evloop, nProducers * eventsPerProducer);
+        Producer<Loop>* producers[producerMax];
+        pthread_barrier_t barrier;
+        ATE_ASSERT(pthread_barrier_init(&barrier, NULL, nProducers + 1) == 0);
+        for (int i = 0; i < nProducers; ++i) {
+            producers[i] = new Producer<Loop>(evloop, handler, i, &barrier,
+                                              batch);
+            producers[i]->start();
+        }
+        pthread_barrier_wait(&barrier);
+        NanoTime start = NanoTime::monotonic();
+        evloop.run();
+        NanoTime end = NanoTime::monotonic();
+        for (int i = 0; i < nProducers; ++i) {
+            producers[i]->join();
+            delete producers[i];
+        }
+        pthread_barrier_destroy(&barrier);
+        double seconds = (end.nanosec - start.nanosec) / 1e9;
+        double total = nProducers * eventsPerProducer / seconds;
+        cout << name << (batch ? " pushN" : " push") 
+             << " producers: " << nProducers 
+             << " events/sec: " << (uint64_t)total
+             << " per producer: " << (uint64_t)(total / nProducers) << endl;
+    }
+
+    template <typename Loop>
+    void benchmarkAll(const char* name)
+    {
+        for (int n = 1; n <= producerMax; n *= 2)
+            benchmark<Loop>(name, n, false);
+        for (int n = 1; n <= producerMax; n *= 2)
+            benchmark<Loop>(name, n, true);
+    }
+}
+
+int main()
+{
+    benchmarkAll<EventLoop>("EventLoop");
+    benchmarkAll<MpscEventLoop>("MpscEventLoop");
+}
@@ -17,6 +17,24 @@ namespace {
         float f;
     };
 
+    int liveOrders = 0;
+    int growEvents = 0;
+
+    // counts only, the hook runs on the allocation path
+    void onGrow(const ate::AllocStats& stats)
+    {
+        assert(stats.name != NULL && stats.grows > 0);
+        ++growEvents;
+    }
+
+    struct Order {
+        int id;
+        double price;
+        Order() : id(0), price(0) { ++liveOrders; }
+        Order(int i, double p) : id(i), price(p) { ++liveOrders; }
+        ~Order() { --liveOrders; }
+    };
+
 }
 
 int main() 
@@ -24,6 +42,7 @@ int main()
     using namespace ate;
     using namespace std;
 
+    AllocRegistry::setGrowHook(onGrow);
     {
         Junk* junks[1024];
         Pool<Junk> pool;
@@ -40,6 +59,115 @@ int main()
             }
             //cout << i << ": allocate() and deallocate()" << endl;
         }
+        assert(growEvents == 4); // 128, 256, 512, 1024
+        const AllocStats& stats = pool.stats();
+        assert(stats.inUse == 0 && stats.peak == 1024);
+        assert(stats.capacity == 1024 && stats.grows == 4);
+        assert(stats.reserved >= 1024 * sizeof(Junk));
+        vector<AllocStats> all;
+        AllocRegistry::snapshot(all);
+        bool found = false;
+        for (size_t i = 0; i < all.size(); ++i) 
+            found = found || strcmp(all[i].name, "Pool") == 0;
+        assert(found);
+    }
+
+    {
+        ObjectPool<Order> orders("OrderPool");
+        Order* order = orders.construct(1, 99.5);
+        assert(order->id == 1 && order->price == 99.5 && liveOrders == 1);
+        orders.destroy(order);
+        assert(liveOrders == 0);
+        Order* batch[1000];
+        for (int i = 0; i < 100; ++i) {
+            orders.constructBulk(1000, batch);
+            assert(liveOrders == 1000);
+            orders.destroyBulk(1000, batch);
+            assert(liveOrders == 0);
+        }
+        {
+            PoolPtr<Order> ptr(orders, orders.construct(2, 1.25));
+            assert(ptr->id == 2 && liveOrders == 1);
+            ptr.reset(orders.construct());
+            assert(ptr->id == 0 && liveOrders == 1);
+        }
+        assert(liveOrders == 0);
+    }
+
+    {
+        Junk* junks[10000];
+        Pool<Junk> pool("TrimPool", 128, 1024, 
+                        RegionPolicy(RegionPolicy::MMAP));
+        for (int i = 0; i < 10000; ++i) 
+            junks[i] = pool.alloc();
+        size_t capacity = pool.capacity();
+        for (int i = 0; i < 10000; i += 2) // chunks keep one block in use
+            pool.dealloc(junks[i]);
+        assert(pool.trim() == 0);
+        for (int i = 1; i < 10000; i += 2) 
+            pool.dealloc(junks[i]);
+        assert(pool.trim(1000) >= capacity - 1000 - 1024);
+        assert(pool.capacity() >= 1000);
+        capacity = pool.capacity();
+        assert(pool.trim() == capacity && pool.capacity() == 0);
+        for (int i = 0; i < 10000; ++i) // grows again
+            junks[i] = pool.alloc();
+        assert(pool.capacity() >= 10000);
+    }
+
+    {
+        SlabAllocator slab;
+        void* ptrs[1024];
+        size_t sizes[1024];
+        srand(1);
+        for (int i = 0; i < 100; ++i) {
+            for (int j = 0; j < 1024; ++j) {
+                // mostly small messages, some above the largest class
+                sizes[j] = (j % 64 == 0) ? 65536 + rand() % 65536 : 
+                    rand() % 4096 + 1;
+                ptrs[j] = slab.malloc(sizes[j]);
+                memset(ptrs[j], j & 0xff, sizes[j]);
+            }
+            for (int j = 0; j < 1024; ++j) {
+                char* p = static_cast<char*>(ptrs[j]);
+                assert(p[0] == (char)(j & 0xff) && 
+                       p[sizes[j] - 1] == (char)(j & 0xff));
+                slab.free(ptrs[j]);
+            }
+        }
+        assert(SlabAllocator::sizeClass(1) == 0);
+        assert(SlabAllocator::sizeClass(33) == 1);
+        assert(SlabAllocator::sizeClass(64) == 2);
+        assert(SlabAllocator::sizeClass(65536) == SlabAllocator::CLASS_COUNT - 1);
+        for (size_t i = 0; i < SlabAllocator::CLASS_COUNT; ++i) {
+            const SlabAllocator::Stats& stats = slab.stats(i);
+            assert(stats.inUse == 0);
+            if (stats.capacity > 0) 
+                cout << "slab class " << stats.blockSize << ": peak " 
+                     << stats.peak << " capacity " << stats.capacity << endl;
+        }
+        assert(slab.largeStats().inUse == 0 && 
+               slab.largeStats().blockSize == 0);
+    }
+
+    {
+        Bin arena(RegionPolicy(), false); // no zero filling
+        Bin::Mark start = arena.mark();
+        char* first = static_cast<char*>(arena.alloc(64));
+        int grown = growEvents;
+        for (int i = 0; i < 1000; ++i) {
+            BinScope scope(arena); // per request scratch memory
+            for (int j = 0; j < 100; ++j)
+                arena.alloc(1000);
+            arena.alloc(100000); // bigger than a chunk
+        }
+        assert(growEvents - grown >= 1000); // one per big block
+        // every scope rewinds to the same position
+        assert(arena.alloc(64) == first + 64);
+        arena.rewind(start);
+        assert(arena.alloc(64) == first);
+        arena.reset();
+        assert(arena.alloc(64) == first);
     }
 
     Bin bin;
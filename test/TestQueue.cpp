@@ -0,0 +1,134 @@
+#include <ate/ate.hpp>
+
+using namespace std;
+using namespace ate;
+
+namespace {
+    typedef FastQueue<int> IntQueue;
+
+    const int capacity = 16;
+    const int pushCount = 100000;
+
+    // take everything queued so far
+    vector<int> drain(IntQueue& queue)
+    {
+        vector<int> values;
+        IntQueue::Node* node = queue.getWork(MicroTime::monotonic());
+        for (; node != NULL; node = node->next)
+            values.push_back(node->obj);
+        return values;
+    }
+
+    int highs = 0;
+    int lows = 0;
+
+    void onHighWater(bool high, void*)
+    {
+        if (high)
+            ++highs;
+        else
+            ++lows;
+    }
+
+    void testPolicies()
+    {
+        Monitor monitor;
+        IntQueue queue(monitor, "TestQueue", 8);
+        for (int i = 0; i < 1000; ++i) // unbounded by default
+            ATE_ASSERT(queue.push(i));
+        ATE_ASSERT(drain(queue).size() == 1000);
+
+        queue.setCapacity(4, IntQueue::FAIL);
+        for (int i = 0; i < 10; ++i)
+            ATE_ASSERT(queue.push(i) == (i < 4));
+        ATE_ASSERT(!queue.tryPush(10) && !queue.emplace(11));
+        ATE_ASSERT(queue.overflowStats().rejected == 8);
+        vector<int> values = drain(queue);
+        ATE_ASSERT(values.size() == 4 && values.back() == 3);
+
+        queue.setCapacity(4, IntQueue::DROP_NEWEST);
+        for (int i = 0; i < 10; ++i)
+            queue.push(i);
+        values = drain(queue);
+        ATE_ASSERT(values.size() == 4 && values.front() == 0);
+        ATE_ASSERT(queue.overflowStats().dropped == 6);
+
+        queue.setCapacity(4, IntQueue::DROP_OLDEST);
+        int batch[10];
+        for (int i = 0; i < 10; ++i)
+            batch[i] = i;
+        queue.pushN(batch, batch + 10);
+        values = drain(queue);
+        ATE_ASSERT(values.size() == 4 && values.front() == 6);
+        ATE_ASSERT(values.back() == 9);
+        ATE_ASSERT(queue.overflowStats().dropped == 12);
+        ATE_ASSERT(queue.overflowStats().blocked == 0);
+
+        queue.setHighWater(3, onHighWater);
+        for (int i = 0; i < 10; ++i)
+            queue.push(i);
+        ATE_ASSERT(highs == 1 && lows == 0);
+        drain(queue);
+        ATE_ASSERT(highs == 1 && lows == 1);
+
+        // a mark below the current depth fires on the next single push
+        queue.setHighWater(0, NULL);
+        for (int i = 0; i < 3; ++i)
+            queue.push(i);
+        queue.setHighWater(2, onHighWater);
+        queue.push(3);
+        ATE_ASSERT(highs == 2 && lows == 1);
+        queue.push(4); // once until the consumer takes the queue
+        ATE_ASSERT(highs == 2);
+        drain(queue);
+        ATE_ASSERT(lows == 2);
+        // and after pushN jumps past it
+        queue.pushN(batch, batch + 3);
+        ATE_ASSERT(highs == 3);
+        queue.push(5);
+        ATE_ASSERT(highs == 3);
+        drain(queue);
+        ATE_ASSERT(lows == 3);
+        queue.setHighWater(0, NULL);
+        cout << "policy test OK" << endl;
+    }
+
+    class Producer : public Thread {
+    public:
+        Producer(IntQueue& queue) : Thread(true), m_queue(queue) {}
+        void run() {
+            for (int i = 0; i < pushCount; ++i)
+                m_queue.push(i);
+        }
+    private:
+        IntQueue& m_queue;
+    };
+
+    // a burst into a blocking queue keeps at most 2 * capacity nodes
+    void testBlock()
+    {
+        Monitor monitor;
+        IntQueue queue(monitor, "TestQueue", 8, 8);
+        queue.setCapacity(capacity, IntQueue::BLOCK);
+        Producer producer(queue);
+        producer.start();
+        int next = 0;
+        while (next < pushCount) {
+            IntQueue::Node* node =
+                queue.getWork(MicroTime::monotonic().add(100));
+            for (; node != NULL; node = node->next)
+                ATE_ASSERT(node->obj == next++);
+        }
+        producer.join();
+        ATE_ASSERT(queue.stats().peak <= 2 * capacity);
+        cout << "block test OK, blocked: " << queue.overflowStats().blocked
+             << " peak nodes: " << queue.stats().peak
+             << " capacity: " << queue.stats().capacity << endl;
+    }
+}
+
+int main()
+{
+    testPolicies();
+    testBlock();
+}
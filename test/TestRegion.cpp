@@ -0,0 +1,62 @@
+#include <ate/ate.hpp>
+
+using namespace std;
+using namespace ate;
+
+namespace {
+    struct Node {
+        Node* next;
+        uint64_t value;
+        char payload[48];
+    };
+
+    const size_t nodeCount = 2 * 1024 * 1024;
+    const size_t hops = 16 * 1024 * 1024;
+
+    // link all nodes of a pool in random order and chase the pointers
+    void benchmark(const char* name, const RegionPolicy& policy)
+    {
+        Pool<Node> pool(name, nodeCount, nodeCount, policy);
+        vector<Node*> nodes(nodeCount);
+        for (size_t i = 0; i < nodeCount; ++i) {
+            nodes[i] = pool.alloc();
+            nodes[i]->value = i;
+        }
+        srand(1);
+        for (size_t i = nodeCount - 1; i > 0; --i) {
+            size_t j = ((size_t)rand() * RAND_MAX + rand()) % (i + 1);
+            Node* tmp = nodes[i];
+            nodes[i] = nodes[j];
+            nodes[j] = tmp;
+        }
+        for (size_t i = 0; i < nodeCount; ++i)
+            nodes[i]->next = nodes[(i + 1) % nodeCount];
+
+        Node* cur = nodes[0];
+        uint64_t sum = 0;
+        MicroTime start = MicroTime::now();
+        for (size_t i = 0; i < hops; ++i) {
+            sum += cur->value;
+            cur = cur->next;
+        }
+        MicroTime end = MicroTime::now();
+        double nanos = (end.microsec - start.microsec) * 1000.0 / hops;
+        cout << name << ": " << nanos << " ns per hop (sum " << sum << ")" 
+             << endl;
+        for (size_t i = 0; i < nodeCount; ++i)
+            pool.dealloc(nodes[i]);
+    }
+}
+
+int main(int argc, char* argv[])
+{
+    int numaNode = argc > 1 ? atoi(argv[1]) : -1;
+    benchmark("heap", RegionPolicy(RegionPolicy::HEAP));
+    benchmark("mmap", RegionPolicy(RegionPolicy::MMAP, numaNode));
+    benchmark("huge page", RegionPolicy(RegionPolicy::HUGE_PAGE, numaNode));
+    benchmark("hugetlb", RegionPolicy(RegionPolicy::HUGETLB, numaNode));
+
+    Bin bin(RegionPolicy(RegionPolicy::HUGE_PAGE));
+    for (int i = 0; i < 100000; ++i) 
+        ATE_ASSERT(strcmp(bin.strdup("hello, world"), "hello, world") == 0);
+}
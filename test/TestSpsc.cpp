@@ -0,0 +1,204 @@
+#include <ate/ate.hpp>
+#include <unistd.h>
+
+using namespace std;
+using namespace ate;
+
+namespace {
+    const uint64_t messageCount = 20000000;
+    const size_t batch = 32;
+
+    struct Message {
+        uint64_t seq;
+        uint64_t payload;
+    };
+
+    int cpuOf(int i)
+    {
+        return i % sysconf(_SC_NPROCESSORS_ONLN);
+    }
+
+    // spin while the other side runs on its own cpu, yield to it otherwise
+    void backoff(int& spins)
+    {
+        if (spins++ < 64) {
+            cpuPause();
+        } else {
+            Thread::yield();
+            spins = 0;
+        }
+    }
+
+    class RingProducer : public Thread {
+    public:
+        RingProducer(SpscRing<Message>& ring, size_t batchSize) 
+            : Thread(true), m_ring(ring), m_batch(batchSize) {}
+        void run() {
+            Thread::setAffinity(cpuOf(1));
+            Message msgs[batch];
+            for (uint64_t seq = 0; seq < messageCount; ) {
+                size_t n = 0;
+                for (; n < m_batch && seq + n < messageCount; ++n) {
+                    msgs[n].seq = seq + n;
+                    msgs[n].payload = ~(seq + n);
+                }
+                size_t pushed = 0;
+                int spins = 0;
+                while (pushed < n) {
+                    size_t k = m_ring.tryPushN(msgs + pushed, msgs + n);
+                    if (k == 0)
+                        backoff(spins);
+                    pushed += k;
+                }
+                seq += n;
+            }
+        }
+    private:
+        SpscRing<Message>& m_ring;
+        size_t m_batch;
+    };
+
+    void benchmark(size_t batchSize)
+    {
+        SpscRing<Message> ring(4096);
+        Thread::setAffinity(cpuOf(0));
+        RingProducer producer(ring, batchSize);
+        NanoTime start = NanoTime::monotonic();
+        producer.start();
+        Message msgs[batch];
+        int spins = 0;
+        for (uint64_t seq = 0; seq < messageCount; ) {
+            size_t n = ring.tryPopN(msgs, batchSize);
+            if (n == 0) {
+                backoff(spins);
+                continue;
+            }
+            for (size_t i = 0; i < n; ++i, ++seq) 
+                ATE_ASSERT(msgs[i].seq == seq && msgs[i].payload == ~seq);
+        }
+        producer.join();
+        NanoTime end = NanoTime::monotonic();
+        cout << "SpscRing batch: " << batchSize << " messages/sec: " 
+             << (uint64_t)(messageCount * 1e9 / (end.nanosec - start.nanosec))
+             << endl;
+    }
+
+    const int eventCount = 100000;
+
+    class OrderHandler : public EventHandler {
+    public:
+        OrderHandler(EventLoop& evloop) : m_evloop(evloop), m_next(0) {}
+        virtual void onEvent(Event& event) {
+            ATE_ASSERT(event.type == m_next);
+            if (++m_next == eventCount)
+                m_evloop.setRunning(false);
+        }
+    private:
+        EventLoop& m_evloop;
+        int m_next;
+    };
+
+    class SourceProducer : public Thread {
+    public:
+        SourceProducer(EventLoop& evloop, EventRing& ring, 
+                       EventHandler& handler) 
+            : Thread(true), m_evloop(evloop), m_ring(ring), 
+              m_handler(handler) {}
+        void run() {
+            Event event;
+            event.handler = &m_handler;
+            for (int i = 0; i < eventCount; ++i) {
+                event.type = i;
+                while (!m_ring.tryPush(event))
+                    Thread::yield();
+                m_evloop.wakeup();
+                if (i % 10000 == 0) // let the loop park
+                    Thread::sleep(1);
+            }
+        }
+    private:
+        EventLoop& m_evloop;
+        EventRing& m_ring;
+        EventHandler& m_handler;
+    };
+
+    void testSource()
+    {
+        EventLoop evloop;
+        EventRing ring(1024);
+        ATE_ASSERT(ring.capacity() == 1024);
+        OrderHandler handler(evloop);
+        evloop.addSource(ring);
+        SourceProducer producer(evloop, ring, handler);
+        producer.start();
+        evloop.run();
+        producer.join();
+        ATE_ASSERT(ring.empty());
+        cout << "event loop source test OK" << endl;
+    }
+
+    const int pingCount = 20000;
+
+    class AckHandler : public EventHandler {
+    public:
+        AckHandler(EventLoop& evloop) : m_evloop(evloop), m_acked(0) {}
+        virtual void onEvent(Event&) {
+            if (m_acked + 1 == pingCount)
+                m_evloop.setRunning(false);
+            releaseFence();
+            m_acked = m_acked + 1;
+        }
+        int acked() const { return m_acked; }
+    private:
+        EventLoop& m_evloop;
+        volatile int m_acked;
+    };
+
+    class PingProducer : public Thread {
+    public:
+        PingProducer(EventLoop& evloop, EventRing& ring, AckHandler& handler)
+            : Thread(true), m_evloop(evloop), m_ring(ring), 
+              m_handler(handler) {}
+        void run() {
+            Event event(0, 0, NULL, &m_handler);
+            for (int i = 0; i < pingCount; ++i) {
+                ATE_ASSERT(m_ring.tryPush(event));
+                m_evloop.wakeup();
+                // a lost wakeup leaves the loop parked: there is no timer
+                NanoTime deadline = NanoTime::monotonic().add(2000);
+                while (m_handler.acked() == i) {
+                    ATE_ASSERT(NanoTime::monotonic() < deadline);
+                    Thread::yield();
+                }
+            }
+        }
+    private:
+        EventLoop& m_evloop;
+        EventRing& m_ring;
+        AckHandler& m_handler;
+    };
+
+    // the loop parks before every ping and only wakeup() wakes it up
+    void testParkWakeup(const char* name, EventLoop::WaitStrategy strategy)
+    {
+        EventLoop evloop;
+        evloop.setWaitStrategy(strategy, 100, 1);
+        EventRing ring(16);
+        AckHandler handler(evloop);
+        evloop.addSource(ring);
+        PingProducer producer(evloop, ring, handler);
+        producer.start();
+        evloop.run();
+        producer.join();
+        cout << name << " park/wakeup test OK" << endl;
+    }
+}
+
+int main()
+{
+    testSource();
+    testParkWakeup("BLOCK", EventLoop::BLOCK);
+    testParkWakeup("SPIN_YIELD_PARK", EventLoop::SPIN_YIELD_PARK);
+    benchmark(1);
+    benchmark(batch);
+}
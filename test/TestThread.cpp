@@ -58,7 +58,7 @@ namespace {
             wlock.lock();
             while (!ready) {
                 mylog("waiting for ready");
-                now = ate::MicroTime::now().add(500);
+                now = ate::MicroTime::monotonic().add(500);
                 if (wlock.timedWait(now) == ETIMEDOUT)
                     mylog("cond wait timed out");
             }
@@ -152,17 +152,16 @@ namespace {
             : Thread(true), m_evloop(evloop) {}
         void run() {            
             int n;
-            Event event;
+            vector<Event> events;
             while (m_evloop.isRunning()) { // not thread safe
                 //n = rand() % 4096 + 1; 
                 n = 1024;
                 mylog("adding " << n << " events");
-                for (int i = 0; i <n; ++i) {                    
-                    event.type = i;
-                    event.handler = &handler;
-                    m_evloop.push(event);
-                    mylog("added " << i << "th event");
-                }
+                events.clear();
+                for (int i = 0; i <n; ++i)
+                    events.push_back(Event(i, 0, NULL, &handler));
+                m_evloop.pushN(events.begin(), events.end());
+                mylog("added " << n << " events");
                 
                 Thread::sleep(60);
             }
@@ -185,7 +184,7 @@ namespace {
         // add timer
         int millis = 6000;
         Timer timer;
-        timer.time = MicroTime::now().add(millis);
+        timer.time = MicroTime::monotonic().add(millis);
         timer.increment = -1;
         timer.tcb = stopLoop;
         timer.aux = &evloop;
@@ -0,0 +1,271 @@
+#include <ate/ate.hpp>
+#include <map>
+
+using namespace std;
+using namespace ate;
+
+namespace {
+    const int timerCount = 1000000;
+    const int spanMillis = 60000;
+    const int tickMicros = 16;
+
+    MicroTime current; // now of the running dispatch()
+    MicroTime previous; // now of the previous dispatch()
+    int fired = 0;
+
+    // fires after its time and not a tick later than needed. A recurring
+    // timer catches up with several expiries in one dispatch().
+    bool checkExpiry(const Timer& timer)
+    {
+        ATE_ASSERT(timer.time <= current);
+        ATE_ASSERT(timer.increment > 0 ||
+                   timer.time.microsec + tickMicros > previous.microsec);
+        ++fired;
+        return timer.increment < 0;
+    }
+
+    bool countExpiry(const Timer&)
+    {
+        ++fired;
+        return true;
+    }
+
+    void testExpiry()
+    {
+        TimerQueue timers;
+        MicroTime base = MicroTime::monotonic();
+        srand(1);
+        Timer timer;
+        timer.increment = -1;
+        timer.tcb = checkExpiry;
+        timer.aux = NULL;
+        for (int i = 0; i < 100000; ++i) {
+            timer.time = base;
+            // from 1 us to 1 hour, some of them expired already
+            timer.time.microsec += rand() % 4 == 0 ? rand() % 1000 :
+                (uint64_t)rand() * rand() % 3600000000U;
+            timer.time.microsec -= 100;
+            timers.add(timer);
+        }
+        timer.time = base;
+        timer.increment = 1; // recurring every ms
+        timers.add(timer);
+        ATE_ASSERT(timers.size() == 100001);
+
+        fired = 0;
+        previous.setMin();
+        current = base;
+        while (timers.size() > 1) {
+            // jump to the next expiry or by a random step
+            if (rand() % 2 == 0 && timers.minTime() > current)
+                current = timers.minTime();
+            else
+                current.microsec += rand() % 5000000;
+            timers.dispatch(current);
+            previous = current;
+            // nothing is left behind
+            ATE_ASSERT(timers.minTime() > current);
+        }
+        ATE_ASSERT(fired >= 100000 + 3600000 / 5000);
+        cout << "expiry test OK, fired: " << fired << endl;
+    }
+
+    TimerQueue* selfQueue;
+    TimerHandle selfHandle;
+
+    // a recurring timer that moves itself once, then cancels itself
+    bool selfCancel(const Timer& timer)
+    {
+        ++fired;
+        if (fired == 1) {
+            MicroTime later = timer.time;
+            ATE_ASSERT(selfQueue->reschedule(selfHandle, later.add(10)));
+        } else {
+            ATE_ASSERT(selfQueue->cancel(selfHandle));
+            ATE_ASSERT(!selfQueue->cancel(selfHandle));
+        }
+        return false;
+    }
+
+    void testCancel()
+    {
+        TimerQueue timers;
+        MicroTime base = MicroTime::monotonic();
+        Timer timer;
+        timer.increment = -1;
+        timer.tcb = countExpiry;
+        timer.aux = NULL;
+        vector<TimerHandle> handles;
+        for (int i = 0; i < 1000; ++i) {
+            timer.time = base;
+            timer.time.add(1000 + i);
+            handles.push_back(timers.add(timer));
+        }
+        for (int i = 0; i < 1000; i += 2) {
+            ATE_ASSERT(timers.cancel(handles[i]));
+            ATE_ASSERT(!timers.cancel(handles[i]));
+        }
+        MicroTime early = base;
+        early.add(1);
+        for (int i = 1; i < 100; i += 2)
+            ATE_ASSERT(timers.reschedule(handles[i], early));
+        ATE_ASSERT(timers.size() == 500);
+        fired = 0;
+        MicroTime due = early;
+        due.microsec += tickMicros; // the tick of early has passed
+        timers.dispatch(due);
+        ATE_ASSERT(fired == 50 && timers.size() == 450);
+        ATE_ASSERT(!timers.cancel(handles[1])); // stale after it fired
+        ATE_ASSERT(!timers.reschedule(handles[1], early));
+
+        selfQueue = &timers;
+        timer.time = base;
+        timer.increment = 1;
+        timer.tcb = selfCancel;
+        selfHandle = timers.add(timer);
+        fired = 0;
+        for (MicroTime now = base; fired < 2; now.add(1))
+            timers.dispatch(now);
+        ATE_ASSERT(timers.size() == 450);
+        timers.dispatch(early.add(10000));
+        ATE_ASSERT(timers.size() == 0);
+
+        // a handle stays stale after its slot is reused many times
+        timer.time = base;
+        timer.increment = -1;
+        timer.tcb = countExpiry;
+        TimerHandle stale = timers.add(timer);
+        ATE_ASSERT(timers.cancel(stale));
+        uint32_t slotMask = HandlePool<Timer>::INDEX_MASK;
+        TimerHandle live = stale;
+        for (int reuses = 0; reuses < 300; ) {
+            live = timers.add(timer);
+            if ((live & slotMask) == (stale & slotMask))
+                ++reuses;
+            ATE_ASSERT(!timers.cancel(stale));
+            ATE_ASSERT(!timers.reschedule(stale, early));
+            if (reuses < 300)
+                ATE_ASSERT(timers.cancel(live));
+        }
+        ATE_ASSERT(timers.size() == 1 && timers.cancel(live));
+        cout << "cancel test OK" << endl;
+    }
+
+    const int posterCount = 4;
+    const int postsPerThread = 10000;
+
+    bool countPosted(const Timer& timer)
+    {
+        if (++fired == posterCount * postsPerThread)
+            static_cast<EventLoop*>(timer.aux)->setRunning(false);
+        return true;
+    }
+
+    class Poster : public Thread {
+    public:
+        Poster(EventLoop& evloop) : Thread(true), m_evloop(evloop) {}
+        void run() {
+            Timer timer;
+            timer.increment = -1;
+            timer.tcb = countPosted;
+            timer.aux = &m_evloop;
+            for (int i = 0; i < postsPerThread; ++i) {
+                timer.time = MicroTime::monotonic();
+                timer.time.microsec += i % 100;
+                m_evloop.postTimer(timer);
+                if (i % 1000 == 0)
+                    Thread::yield();
+            }
+        }
+    private:
+        EventLoop& m_evloop;
+    };
+
+    // other threads post timers to a running loop
+    void testPost()
+    {
+        EventLoop evloop;
+        Poster* posters[posterCount];
+        fired = 0;
+        for (int i = 0; i < posterCount; ++i) {
+            posters[i] = new Poster(evloop);
+            posters[i]->start();
+        }
+        evloop.run();
+        for (int i = 0; i < posterCount; ++i) {
+            posters[i]->join();
+            delete posters[i];
+        }
+        ATE_ASSERT(fired == posterCount * postsPerThread);
+        cout << "post test OK" << endl;
+    }
+
+    void benchmark()
+    {
+        vector<MicroTime> times;
+        MicroTime base = MicroTime::monotonic();
+        srand(1);
+        for (int i = 0; i < timerCount; ++i) {
+            MicroTime time = base;
+            time.microsec += (uint64_t)rand() * rand() %
+                ((uint64_t)spanMillis * 1000);
+            times.push_back(time);
+        }
+
+        Timer timer;
+        timer.increment = -1;
+        timer.tcb = countExpiry;
+        timer.aux = NULL;
+        TimerQueue timers;
+        fired = 0;
+        NanoTime start = NanoTime::monotonic();
+        for (int i = 0; i < timerCount; ++i) {
+            timer.time = times[i];
+            timers.add(timer);
+        }
+        NanoTime mid = NanoTime::monotonic();
+        MicroTime now = base;
+        for (int ms = 0; ms <= spanMillis; ++ms) {
+            timers.dispatch(now);
+            now.add(1);
+        }
+        NanoTime end = NanoTime::monotonic();
+        ATE_ASSERT(fired == timerCount && timers.size() == 0);
+        cout << "TimerQueue timers: " << timerCount
+             << " add: " << (mid.nanosec - start.nanosec) / timerCount
+             << " ns expire: " << (end.nanosec - mid.nanosec) / timerCount
+             << " ns" << endl;
+
+        // std::multimap as a reference for an O(log n) timer queue
+        multimap<uint64_t, Timer> tree;
+        fired = 0;
+        start = NanoTime::monotonic();
+        for (int i = 0; i < timerCount; ++i) {
+            timer.time = times[i];
+            tree.insert(make_pair(times[i].microsec, timer));
+        }
+        mid = NanoTime::monotonic();
+        now = base;
+        for (int ms = 0; ms <= spanMillis; ++ms) {
+            while (!tree.empty() && tree.begin()->first <= now.microsec) {
+                tree.begin()->second.tcb(tree.begin()->second);
+                tree.erase(tree.begin());
+            }
+            now.add(1);
+        }
+        end = NanoTime::monotonic();
+        ATE_ASSERT(fired == timerCount);
+        cout << "multimap timers: " << timerCount
+             << " add: " << (mid.nanosec - start.nanosec) / timerCount
+             << " ns expire: " << (end.nanosec - mid.nanosec) / timerCount
+             << " ns" << endl;
+    }
+}
+
+int main()
+{
+    testExpiry();
+    testCancel();
+    testPost();
+    benchmark();
+}
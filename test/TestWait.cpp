@@ -0,0 +1,77 @@
+#include <ate/ate.hpp>
+#include <algorithm>
+#include <unistd.h>
+
+using namespace std;
+using namespace ate;
+
+namespace {
+    const int pingCount = 5000;
+
+    volatile uint64_t sentAt = 0; // monotonic nanos of the last ping
+    volatile int acked = 0;
+    vector<uint64_t> latencies;
+
+    class PingHandler : public EventHandler {
+    public:
+        virtual void onEvent(Event&) {
+            latencies.push_back(NanoTime::monotonic().nanosec - sentAt);
+            releaseFence();
+            acked = 1;
+        }
+    };
+
+    bool stopLoop(const Timer& timer)
+    {
+        static_cast<EventLoop*>(timer.aux)->setRunning(false);
+        return true;
+    }
+
+    class LoopThread : public Thread {
+    public:
+        LoopThread(EventLoop& evloop) : Thread(true), m_evloop(evloop) {}
+        void run() { m_evloop.run(); }
+    private:
+        EventLoop& m_evloop;
+    };
+
+    // one ping at a time: the loop is idle when each ping arrives
+    void benchmark(const char* name, EventLoop::WaitStrategy strategy)
+    {
+        EventLoop evloop;
+        evloop.setWaitStrategy(strategy);
+        PingHandler handler;
+        LoopThread thread(evloop);
+        thread.start();
+        latencies.clear();
+        for (int i = 0; i < pingCount; ++i) {
+            Thread::sleep(0); // let the loop go idle
+            acked = 0;
+            sentAt = NanoTime::monotonic().nanosec;
+            evloop.push(Event(0, i, NULL, &handler));
+            while (acked == 0)
+                Thread::yield();
+        }
+        Timer timer;
+        timer.time.setMin();
+        timer.increment = -1;
+        timer.tcb = stopLoop;
+        timer.aux = &evloop;
+        evloop.postTimer(timer);
+        thread.join();
+        sort(latencies.begin(), latencies.end());
+        cout << name << " wakeup latency ns, median: "
+             << latencies[pingCount / 2]
+             << " p99: " << latencies[pingCount * 99 / 100] << endl;
+    }
+}
+
+int main()
+{
+    benchmark("BLOCK", EventLoop::BLOCK);
+    benchmark("SPIN_YIELD_PARK", EventLoop::SPIN_YIELD_PARK);
+    if (sysconf(_SC_NPROCESSORS_ONLN) > 1) // spinning needs its own core
+        benchmark("BUSY_SPIN", EventLoop::BUSY_SPIN);
+    else
+        cout << "BUSY_SPIN skipped on a single cpu" << endl;
+}